@@ -4,7 +4,31 @@
 #include <string>
 #include <algorithm>
 #include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <functional>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #define GL_SILENCE_DEPRECATION
+#define GL_GLEXT_PROTOTYPES
 #include <GLFW/glfw3.h>
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
@@ -13,12 +37,131 @@
 #include "tinyfiledialogs.h"
 #include <utility> 
 
-// Add these declarations at the top of your file
-std::vector<ImFont*> loadedFonts;
+// ImGui's copy of stb_truetype, compiled privately into this file for on-demand glyph rasterization
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "imstb_truetype.h"
+
+// Canvas text glyphs are rasterized as signed distance fields the first time they are drawn, at
+// sdfFontSize, into shared atlas pages. Values are 0.5 + distance / (2 * sdfSpread), edge at 0.5.
+const float sdfFontSize = 48.0f;
+const int sdfSpread = 6; // Texels of distance encoded on each side of a glyph edge
+const int glyphPageSize = 1024;
+bool sdfTextEnabled = true;
+
+struct Glyph {
+    int page;          // -1 for glyphs with nothing to draw, e.g. spaces
+    int x, y;          // Top-left of the field in the page
+    int width, height;
+    float offsetX;     // Field's top-left relative to the pen position at the top of the line, at sdfFontSize
+    float offsetY;
+    float advance;     // At sdfFontSize
+};
+
+struct FontFace {
+    std::string name;
+    std::string path;  // Empty for ImGui's built-in font, whose data is copied at startup
+    std::vector<unsigned char> fileData;
+    stbtt_fontinfo info;
+    bool loaded;       // The file has been read and parsed
+    bool failed;
+    float scale;       // stb_truetype scale for sdfFontSize
+    float ascent;      // In pixels at sdfFontSize
+    uint64_t hash;     // Of fileData, once loaded
+    std::unordered_map<unsigned int, Glyph> glyphs;
+
+    // Glyphs found in the on-disk cache, adopted on load if the file's hash still matches
+    uint64_t cachedHash;
+    std::vector<std::pair<unsigned int, Glyph>> cachedGlyphs;
+};
+
+// A page of the glyph atlas, filled shelf by shelf. New pages are added when the last one is full.
+struct GlyphPage {
+    GLuint texture;
+    unsigned char* pixels;             // Points into storage, or into the mapped cache file
+    std::vector<unsigned char> storage;
+    int shelfX;
+    int shelfY;
+    int shelfHeight;
+    int dirtyMinY;     // Rows written since the last upload; dirtyMinY >= dirtyMaxY when clean
+    int dirtyMaxY;
+};
+
+// Glyph quad placed by LayoutText, in the caller's coordinates
+struct PlacedGlyph {
+    const Glyph* glyph;
+    unsigned int codepoint;
+    ImVec2 origin;     // Pen position the glyph was placed at
+    ImVec2 min;
+    ImVec2 max;
+};
+
+// Glyph coverage resampled from the distance field at one font size, ready to be blitted by the CPU renderer
+struct GlyphBitmap {
+    int offsetX;       // Top-left relative to the pen position, rounded out to whole pixels
+    int offsetY;
+    int width;
+    int height;
+    std::vector<unsigned char> coverage;
+};
+
+std::vector<FontFace> fontFaces;
 std::vector<std::string> fontNames;
+std::vector<GlyphPage> glyphPages;
+
+// Guards fontFaces, glyphPages and the glyph bitmap cache, which text images also use from worker threads.
+// GL calls on the atlas stay on the main thread.
+std::mutex glyphMutex;
+
+// Rasterized glyphs persist across launches in this file, which is mapped back in at startup
+const char* glyphCachePath = "font_atlas.cache";
+const uint32_t glyphCacheVersion = 1;
+void* glyphCacheMapping = nullptr;
+size_t glyphCacheMappingSize = 0;
+bool glyphCacheDirty = false;
+bool glyphCacheStale = false;  // Cached glyphs were discarded, leaving dead space in the pages; rebuilt next launch
 
 
+// One resident tile of an image too large to upload as a single texture
+struct ImageTile {
+    GLuint texture;
+    GLuint maskTexture; // 0 while the image has no eraser mask
+    int level;          // Pyramid level the tile was cut from, 0 = full resolution
+    int column;
+    int row;
+    int lastUsedFrame;
+};
+
+// Pixel buffers are shared by an image, its copies and the undo snapshots holding it, so taking a
+// snapshot copies no pixels. Image pixels never change after loading; the eraser masks do, and an
+// image takes its own copy of them before writing while they are shared (MakeMasksUnique).
+typedef std::shared_ptr<const std::vector<unsigned char>> PixelBuffer;
+typedef std::shared_ptr<std::vector<unsigned char>> MaskBuffer;
+
+// One level of an image's opaque-area bitmask, rows packed 64 cells to a word
+struct HitMaskLevel {
+    int width;        // In cells
+    int height;
+    int wordsPerRow;
+    std::vector<uint64_t> bits;
+};
+
+struct Image;
+struct Text;
+
+// An object's entry in a spatial index; depth is -1 while the object is not in it
+struct SpatialEntry {
+    ImVec2 boundsMin;     // World-space box around the object, as last indexed
+    ImVec2 boundsMax;
+    int depth = -1;
+    int x = 0;
+    int y = 0;
+    Image* image = nullptr;  // The indexed object; one of the two is set
+    Text* text = nullptr;
+};
+
 struct Image {
+    int id;               // Stable identity, survives reordering and undo snapshots
     GLuint texture;
     int width;
     int height;
@@ -30,7 +173,7 @@ struct Image {
     bool selected;
     bool mirrored;
     int uploadOrder;
-    std::vector<unsigned char> data;
+    PixelBuffer data;
     bool eraserMode;
     int eraserSize;
     float rotation; 
@@ -39,22 +182,117 @@ struct Image {
     int activeZoomCorner;
     ImVec2 zoomStartPos;
     float zoomStartValue;
-    std::vector<unsigned char> pixelData;  // Add this field
+    PixelBuffer pixelData;
     bool isTextImage;
     int originalWidth;
     int originalHeight;
+    bool loading;         // Placeholder until the worker pool has decoded the pixels
+    bool tiled;           // Drawn from streamed tiles; texture then holds the low-res preview level
+    int previewLevel;     // Smallest pyramid level that fits in a single tile
+    std::vector<PixelBuffer> pyramid;  // Downsampled levels 1..previewLevel of data
+    std::vector<ImageTile> tiles;
+    MaskBuffer mask;                   // Eraser mask, 255 = visible; null until first erase
+    std::vector<MaskBuffer> maskPyramid;  // Mask levels matching pyramid, for tiled images
+    std::shared_ptr<std::vector<HitMaskLevel>> hitMask;  // Where the image is opaque, for hit testing; null = all of it
+    GLuint maskTexture;
+    int lastVisibleFrame; // For LRU eviction of the texture while the image is off screen
+    bool hasDirtyRect;    // Pixels in [dirtyMin, dirtyMax) changed and haven't been uploaded yet
+    int dirtyMinX;
+    int dirtyMinY;
+    int dirtyMaxX;
+    int dirtyMaxY;
+
+    // What a text image was rendered from, so it can be re-rendered sharp when zoomed in
+    std::string textContent;
+    int textFontIndex;
+    float textFontSize;
+    ImVec4 textFillColor;
+    ImVec4 textStrokeColor;
+    float textStrokeWidth;
+    GLuint sharpTexture;  // The text rendered at sharpScale times its base size; 0 if none
+    int sharpWidth;
+    int sharpHeight;
+    float sharpScale;
+    bool sharpPending;    // A re-render is queued on the worker pool
+    float sharpRequestScale;   // Scale the next re-render would use, while it settles; 0 if none
+    double sharpRequestTime;   // When sharpRequestScale was last changed
+
+    SpatialEntry spatial; // Entry in imageIndex, boxed around the rotated image
 };
 
-std::vector<Image> images;
+// Text images keep their pixels in pixelData, regular images in data
+const std::vector<unsigned char>& ImagePixels(const Image& img)
+{
+    static const std::vector<unsigned char> none;  // Still loading
+    const PixelBuffer& pixels = img.isTextImage ? img.pixelData : img.data;
+    return pixels ? *pixels : none;
+}
+
+// Kept in drawing order, back to front. A list, so images never move in memory when the order changes.
+std::list<Image> images;
 bool show_metrics = false;
+bool sendImageToBack = false; // Set by an image's "To Back" button, applied once the frame's images are drawn
+int imageToDelete = -1;       // Set by an image's "Delete" button, removed at the end of the frame
+
+// Objects drawn and skipped as off screen in the current frame, for the metrics window
+int imagesDrawn = 0;
+int imagesCulled = 0;
+int textsDrawn = 0;
+int textsCulled = 0;
 int nextUploadOrder = 0;
+int nextImageId = 0;
+int frameCounter = 0;
+
+
+struct ImageTransform {
+    ImVec2 position;
+    float zoom;
+    float rotation;
+    bool mirrored;
+};
+
+// An image taken out of the list by an undo step, with the index it had
+struct RemovedImage {
+    int index;
+    Image image;
+};
 
+// Eraser strokes are undone per 64x64 tile of the mask: a stroke keeps the tiles it touched as they
+// were before it, run-length encoded, and undoing swaps them with the current ones
+const int maskUndoTileSize = 64;
+
+struct MaskTile {
+    int column;
+    int row;
+    std::vector<unsigned char> runs;  // (count, value) pairs, row by row
+};
+
+enum UndoCommandType
+{
+    UndoInsert,    // imageIds were added
+    UndoRemove,    // imageIds were deleted
+    UndoTransform, // imageIds[0] was moved, zoomed, rotated or mirrored
+    UndoToBack,    // imageIds[0] was sent to the back
+    UndoErase,     // imageIds[0] had an eraser stroke over maskTiles
+};
 
-struct ImageState {
-    std::vector<Image> images;
-    int nextUploadOrder;
+// One step of the undo history, holding only the change it makes. Images an insert or remove has
+// taken out of the list wait in removed; they share their pixels, so no step copies pixel data.
+struct UndoCommand {
+    UndoCommandType type;
+    std::vector<int> imageIds;
+    std::vector<RemovedImage> removed;
+    ImageTransform before;  // UndoTransform
+    ImageTransform after;
+    int index;              // UndoToBack: where the image was in the list
+    int uploadOrderBefore;
+    int uploadOrderAfter;
+    std::vector<MaskTile> maskTiles;  // UndoErase: the other side of the stroke from the current mask
 };
 
+// historyTextureHolders points into removed, which has to stay put while the histories grow
+static_assert(std::is_nothrow_move_constructible<UndoCommand>::value, "UndoCommand must move without copying");
+
 struct Text {
     std::string content;
     ImVec2 position;
@@ -64,16 +302,217 @@ struct Text {
     float size;
     bool selected;
     int fontIndex;  // Add this line to store the font index
+
+    // Cached stroked rendering, rebuilt only when one of the inputs below changes
+    GLuint cacheTexture = 0;
+    int cacheWidth = 0;
+    int cacheHeight = 0;
+    std::string cacheContent;
+    int cacheFontIndex = -1;
+    float cacheSize = 0.0f;
+    ImVec4 cacheFillColor;
+    ImVec4 cacheStrokeColor;
+    float cacheStrokeWidth = 0.0f;
+
+    // Laid-out size in world units, remeasured only when one of the inputs below changes
+    ImVec2 measuredSize;
+    std::string measuredContent;
+    int measuredFontIndex = -1;
+    float measuredFontSize = 0.0f;
+
+    SpatialEntry spatial; // Entry in textIndex
 };
 bool isAddTextPopupOpen = false;
 std::vector<Text> texts;
 
-std::vector<ImageState> undoStates;
-std::vector<ImageState> redoStates;
+std::vector<UndoCommand> undoHistory;
+std::vector<UndoCommand> redoHistory;
+
+// The images waiting in the histories that still hold textures, so the texture budget can reach
+// them without walking every step. Kept by TakeImagesOut, PutImagesBack, DiscardUndoCommands and
+// EnforceTextureBudget.
+std::vector<Image*> historyTextureHolders;
 
+// The canvas camera. Images and texts live in world coordinates; panning and zooming only change these two,
+// and everything is mapped to the screen when it is drawn or hit-tested.
 ImVec2 gridOffset(0.0f, 0.0f);
 float gridScale = 1.0f;
 
+ImVec2 WorldToScreen(ImVec2 world)
+{
+    return ImVec2(world.x * gridScale + gridOffset.x, world.y * gridScale + gridOffset.y);
+}
+
+ImVec2 ScreenToWorld(ImVec2 screen)
+{
+    return ImVec2((screen.x - gridOffset.x) / gridScale, (screen.y - gridOffset.y) / gridScale);
+}
+
+// Screen pixels per image pixel
+float ImageScreenScale(const Image& img)
+{
+    return img.zoom * gridScale;
+}
+
+// Spatial index over world bounds, used to find the images under the cursor and the texts in
+// view without testing every one. A loose quadtree: each depth is a grid of cells twice the size
+// of the one below, and an object lives in one cell at the depth where the cell is at least as
+// large as the object. Cells are queried with twice their size (the loose bounds), so an object
+// centered in a cell always fits. Depths are hash maps of occupied cells, so the world needs no
+// fixed extent. Images and texts are kept in separate indexes.
+const float spatialCellSize = 64.0f;  // World size of the cells at depth 0
+const int spatialDepths = 24;
+struct SpatialIndex {
+    std::unordered_map<uint64_t, std::vector<SpatialEntry*>> cells[spatialDepths];
+    int count = 0;
+};
+SpatialIndex imageIndex;
+SpatialIndex textIndex;
+
+uint64_t SpatialCellKey(int x, int y)
+{
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+// World-space box around the image at its current rotation
+void ComputeImageBounds(const Image& img, ImVec2& boundsMin, ImVec2& boundsMax)
+{
+    float displayWidth = (img.isTextImage ? img.originalWidth : img.width) * img.zoom;
+    float displayHeight = (img.isTextImage ? img.originalHeight : img.height) * img.zoom;
+    ImVec2 center(img.position.x + displayWidth * 0.5f, img.position.y + displayHeight * 0.5f);
+    float c = std::fabs(cosf(img.rotation * 3.14159f / 180.0f));
+    float s = std::fabs(sinf(img.rotation * 3.14159f / 180.0f));
+    float halfWidth = 0.5f * (displayWidth * c + displayHeight * s);
+    float halfHeight = 0.5f * (displayWidth * s + displayHeight * c);
+    boundsMin = ImVec2(center.x - halfWidth, center.y - halfHeight);
+    boundsMax = ImVec2(center.x + halfWidth, center.y + halfHeight);
+}
+
+void RemoveFromSpatialIndex(SpatialIndex& index, SpatialEntry& spatial)
+{
+    if (spatial.depth < 0)
+    {
+        return;
+    }
+    auto& cells = index.cells[spatial.depth];
+    auto cell = cells.find(SpatialCellKey(spatial.x, spatial.y));
+    if (cell != cells.end())
+    {
+        std::vector<SpatialEntry*>& entries = cell->second;
+        auto entry = std::find(entries.begin(), entries.end(), &spatial);
+        if (entry != entries.end())
+        {
+            *entry = entries.back();
+            entries.pop_back();
+            index.count--;
+        }
+        if (entries.empty())
+        {
+            cells.erase(cell);
+        }
+    }
+    spatial.depth = -1;
+}
+
+// Inserts the entry, or moves it to another cell if its bounds changed since the last call
+void UpdateSpatialIndex(SpatialIndex& index, SpatialEntry& spatial, ImVec2 boundsMin, ImVec2 boundsMax)
+{
+    if (spatial.depth >= 0 && boundsMin.x == spatial.boundsMin.x && boundsMin.y == spatial.boundsMin.y &&
+        boundsMax.x == spatial.boundsMax.x && boundsMax.y == spatial.boundsMax.y)
+    {
+        return;
+    }
+    spatial.boundsMin = boundsMin;
+    spatial.boundsMax = boundsMax;
+
+    float extent = std::max(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y);
+    int depth = 0;
+    float cellSize = spatialCellSize;
+    while (cellSize < extent && depth < spatialDepths - 1)
+    {
+        cellSize *= 2.0f;
+        depth++;
+    }
+    int x = (int)std::floor((boundsMin.x + boundsMax.x) * 0.5f / cellSize);
+    int y = (int)std::floor((boundsMin.y + boundsMax.y) * 0.5f / cellSize);
+    if (spatial.depth == depth && spatial.x == x && spatial.y == y)
+    {
+        return;
+    }
+
+    RemoveFromSpatialIndex(index, spatial);
+    spatial.depth = depth;
+    spatial.x = x;
+    spatial.y = y;
+    index.cells[depth][SpatialCellKey(x, y)].push_back(&spatial);
+    index.count++;
+}
+
+// Collects the entries whose bounds overlap [queryMin, queryMax] in world space, in no particular order
+void QuerySpatialIndex(const SpatialIndex& index, ImVec2 queryMin, ImVec2 queryMax, std::vector<SpatialEntry*>& result)
+{
+    float cellSize = spatialCellSize;
+    for (int depth = 0; depth < spatialDepths; ++depth, cellSize *= 2.0f)
+    {
+        const auto& cells = index.cells[depth];
+        if (cells.empty())
+        {
+            continue;
+        }
+
+        // Cells whose loose bounds, half a cell wider on each side, can reach the query box
+        int minX = (int)std::floor(queryMin.x / cellSize - 0.5f);
+        int minY = (int)std::floor(queryMin.y / cellSize - 0.5f);
+        int maxX = (int)std::floor(queryMax.x / cellSize + 0.5f);
+        int maxY = (int)std::floor(queryMax.y / cellSize + 0.5f);
+        auto collect = [&](const std::vector<SpatialEntry*>& entries)
+        {
+            for (SpatialEntry* spatial : entries)
+            {
+                if (spatial->boundsMax.x >= queryMin.x && spatial->boundsMin.x <= queryMax.x &&
+                    spatial->boundsMax.y >= queryMin.y && spatial->boundsMin.y <= queryMax.y)
+                {
+                    result.push_back(spatial);
+                }
+            }
+        };
+
+        // Large query boxes touch more cells than are occupied; walk the occupied ones instead
+        if ((double)(maxX - minX + 1) * (maxY - minY + 1) > cells.size())
+        {
+            for (const auto& cell : cells)
+            {
+                collect(cell.second);
+            }
+            continue;
+        }
+        for (int y = minY; y <= maxY; ++y)
+        {
+            for (int x = minX; x <= maxX; ++x)
+            {
+                auto cell = cells.find(SpatialCellKey(x, y));
+                if (cell != cells.end())
+                {
+                    collect(cell->second);
+                }
+            }
+        }
+    }
+}
+
+void RemoveImageFromSpatialIndex(Image& img)
+{
+    RemoveFromSpatialIndex(imageIndex, img.spatial);
+}
+
+void UpdateImageSpatialIndex(Image& img)
+{
+    ImVec2 boundsMin, boundsMax;
+    ComputeImageBounds(img, boundsMin, boundsMax);
+    img.spatial.image = &img;
+    UpdateSpatialIndex(imageIndex, img.spatial, boundsMin, boundsMax);
+}
+
 const char* FontGetter(void* vec, int idx)
 {
     auto& vector = *static_cast<std::vector<std::string>*>(vec);
@@ -83,98 +522,253 @@ const char* FontGetter(void* vec, int idx)
 }
 
 // Declarations
-std::pair<GLuint, std::vector<unsigned char>> RenderTextToTexture(const char* text, ImFont* font, float fontSize, ImVec4 fillColor, ImVec4 strokeColor, float strokeWidth);
-void RenderTextToBuffer(std::vector<unsigned char>& buffer, int bufferWidth, int bufferHeight, 
-                        const char* text, ImFont* font, float fontSize, float x, float y, ImVec4 color);
+GLuint CreateTextureFromData(const std::vector<unsigned char>& data, int width, int height, GLenum format = GL_RGBA);
+std::vector<unsigned char> RenderTextToPixels(const char* text, int fontIndex, float fontSize, ImVec4 fillColor, ImVec4 strokeColor, float strokeWidth,
+                                              int& texWidth, int& texHeight, float padding = 5.0f);
+void RenderTextCoverage(std::vector<unsigned char>& coverage, int bufferWidth, int bufferHeight,
+                        const char* text, int fontIndex, float fontSize, float x, float y);
+ImVec2 MeasureText(int fontIndex, float fontSize, const char* text);
+void LayoutText(int fontIndex, float fontSize, ImVec2 pos, const char* text, std::vector<PlacedGlyph>& placed);
+std::vector<float> DistanceToCoverage(const std::vector<unsigned char>& coverage, int width, int height, bool inside);
 void DrawTriangle(std::vector<unsigned char>& buffer, int width, int height, ImVec2 pos[3], ImVec4 col);
 bool PointInTriangle(ImVec2 pt, ImVec2 v1, ImVec2 v2, ImVec2 v3);
 float Sign(ImVec2 p1, ImVec2 p2, ImVec2 p3);
 
 // Function implementations
-std::pair<GLuint, std::vector<unsigned char>> RenderTextToTexture(const char* text, ImFont* font, float fontSize, ImVec4 fillColor, ImVec4 strokeColor, float strokeWidth)
+
+// Rasterizes text with an optional outline into an RGBA buffer. The outline comes from a distance
+// transform of the glyph coverage, so its cost doesn't depend on the stroke width.
+std::vector<unsigned char> RenderTextToPixels(const char* text, int fontIndex, float fontSize, ImVec4 fillColor, ImVec4 strokeColor, float strokeWidth,
+                                              int& texWidth, int& texHeight, float padding)
 {
     // Calculate the size of the text
-    ImVec2 textSize = font->CalcTextSizeA(fontSize, FLT_MAX, 0.0f, text);
+    ImVec2 textSize = MeasureText(fontIndex, fontSize, text);
     
     // Add some padding
-    int texWidth = (int)(textSize.x + strokeWidth * 2 + 10);
-    int texHeight = (int)(textSize.y + strokeWidth * 2 + 10);
+    texWidth = (int)(textSize.x + strokeWidth * 2 + padding * 2);
+    texHeight = (int)(textSize.y + strokeWidth * 2 + padding * 2);
 
-    // Create an image buffer
-    std::vector<unsigned char> imageBuffer(texWidth * texHeight * 4, 0);
+    // Render the glyph coverage once
+    std::vector<unsigned char> coverage((size_t)texWidth * texHeight, 0);
+    RenderTextCoverage(coverage, texWidth, texHeight, text, fontIndex, fontSize, strokeWidth + padding, strokeWidth + padding);
 
-    // Render stroke
+    std::vector<float> distance;
     if (strokeWidth > 0)
     {
-        for (float x = -strokeWidth; x <= strokeWidth; x += 0.5f)
+        distance = DistanceToCoverage(coverage, texWidth, texHeight, false);
+    }
+
+    // Composite the fill over the stroke (straight alpha, as the ImGui backend blends)
+    std::vector<unsigned char> imageBuffer((size_t)texWidth * texHeight * 4, 0);
+    for (size_t i = 0; i < coverage.size(); ++i)
+    {
+        float fillAlpha = coverage[i] / 255.0f * fillColor.w;
+        float strokeAlpha = 0.0f;
+        if (strokeWidth > 0)
         {
-            for (float y = -strokeWidth; y <= strokeWidth; y += 0.5f)
-            {
-                RenderTextToBuffer(imageBuffer, texWidth, texHeight, text, font, fontSize, 
-                                   strokeWidth + 5 + x, strokeWidth + 5 + y, strokeColor);
-            }
+            // Pixels inside the glyph are at distance 0; the outer edge gets a one pixel ramp
+            strokeAlpha = std::min(std::max(strokeWidth + 0.5f - distance[i], 0.0f), 1.0f) * strokeColor.w;
         }
+
+        float alpha = fillAlpha + strokeAlpha * (1.0f - fillAlpha);
+        if (alpha <= 0.0f)
+        {
+            continue;
+        }
+        float strokeWeight = strokeAlpha * (1.0f - fillAlpha);
+        unsigned char* out = &imageBuffer[i * 4];
+        out[0] = (unsigned char)((fillColor.x * fillAlpha + strokeColor.x * strokeWeight) / alpha * 255.0f);
+        out[1] = (unsigned char)((fillColor.y * fillAlpha + strokeColor.y * strokeWeight) / alpha * 255.0f);
+        out[2] = (unsigned char)((fillColor.z * fillAlpha + strokeColor.z * strokeWeight) / alpha * 255.0f);
+        out[3] = (unsigned char)(alpha * 255.0f);
+    }
+
+    return imageBuffer;
+}
+
+// Coverage bitmaps keyed by font, size (in 1/16 px) and codepoint. Flushed as a whole when it outgrows its budget.
+std::unordered_map<uint64_t, GlyphBitmap> glyphBitmapCache;
+size_t glyphBitmapBytes = 0;
+const size_t maxGlyphBitmapBytes = 32 * 1024 * 1024;
+
+const GlyphBitmap& AcquireGlyphBitmap(int fontIndex, float fontSize, unsigned int codepoint, const Glyph& glyph)
+{
+    uint64_t key = ((uint64_t)fontIndex << 48) | ((uint64_t)std::lround(fontSize * 16.0f) << 24) | (codepoint & 0xFFFFFF);
+    auto found = glyphBitmapCache.find(key);
+    if (found != glyphBitmapCache.end())
+    {
+        return found->second;
+    }
+    if (glyphBitmapBytes > maxGlyphBitmapBytes)
+    {
+        glyphBitmapCache.clear();
+        glyphBitmapBytes = 0;
     }
 
-    // Render fill
-    RenderTextToBuffer(imageBuffer, texWidth, texHeight, text, font, fontSize, 
-                       strokeWidth + 5, strokeWidth + 5, fillColor);
+    // Distance field texels per output pixel, and output pixels per step of the 8-bit field (edge at 128)
+    float scale = fontSize / sdfFontSize;
+    float texelsPerPixel = 1.0f / scale;
+    float distanceScale = sdfSpread / 128.0f / texelsPerPixel;
+
+    GlyphBitmap bitmap;
+    float left = glyph.offsetX * scale;
+    float top = glyph.offsetY * scale;
+    bitmap.offsetX = (int)std::floor(left);
+    bitmap.offsetY = (int)std::floor(top);
+    bitmap.width = (int)std::ceil(left + glyph.width * scale) - bitmap.offsetX;
+    bitmap.height = (int)std::ceil(top + glyph.height * scale) - bitmap.offsetY;
+    bitmap.coverage.assign((size_t)bitmap.width * bitmap.height, 0);
+
+    const GlyphPage& page = glyphPages[glyph.page];
+    for (int py = 0; py < bitmap.height; py++)
+    {
+        float v = (bitmap.offsetY + py + 0.5f - top) * texelsPerPixel - 0.5f;
+        int ty = std::min(std::max((int)std::floor(v), 0), glyph.height - 2);
+        float fy = std::min(std::max(v - ty, 0.0f), 1.0f);
+        const unsigned char* row0 = &page.pixels[(size_t)(glyph.y + ty) * glyphPageSize + glyph.x];
+        const unsigned char* row1 = row0 + glyphPageSize;
+        for (int px = 0; px < bitmap.width; px++)
+        {
+            float u = (bitmap.offsetX + px + 0.5f - left) * texelsPerPixel - 0.5f;
+            int tx = std::min(std::max((int)std::floor(u), 0), glyph.width - 2);
+            float fx = std::min(std::max(u - tx, 0.0f), 1.0f);
+
+            // Bilinear sample of the field, turned into coverage with a one pixel ramp across the edge
+            float upper = row0[tx] + (row0[tx + 1] - row0[tx]) * fx;
+            float lower = row1[tx] + (row1[tx + 1] - row1[tx]) * fx;
+            float field = upper + (lower - upper) * fy;
+            float alpha = std::min(std::max((field - 128.0f) * distanceScale + 0.5f, 0.0f), 1.0f);
+            bitmap.coverage[(size_t)py * bitmap.width + px] = (unsigned char)(alpha * 255.0f);
+        }
+    }
 
-    // Create OpenGL texture
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texWidth, texHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageBuffer.data());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glyphBitmapBytes += bitmap.coverage.size();
+    return glyphBitmapCache.emplace(key, std::move(bitmap)).first->second;
+}
 
-    return std::make_pair(textureID, imageBuffer);
+// dst = max(dst, src) over a span, sixteen bytes at a time where the CPU allows
+void MaxSpan(unsigned char* dst, const unsigned char* src, int count)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_max_epu8(a, b));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16)
+    {
+        vst1q_u8(dst + i, vmaxq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        dst[i] = std::max(dst[i], src[i]);
+    }
 }
 
-void RenderTextToBuffer(std::vector<unsigned char>& buffer, int bufferWidth, int bufferHeight, 
-                        const char* text, ImFont* font, float fontSize, float x, float y, ImVec4 color)
+// Writes the glyph coverage of the text into an 8-bit buffer, keeping the maximum where glyphs overlap
+void RenderTextCoverage(std::vector<unsigned char>& coverage, int bufferWidth, int bufferHeight,
+                        const char* text, int fontIndex, float fontSize, float x, float y)
 {
-    ImFontAtlas* atlas = font->ContainerAtlas;
-    for (const char* c = text; *c != '\0'; c++)
+    std::lock_guard<std::mutex> lock(glyphMutex);
+    std::vector<PlacedGlyph> placed;
+    LayoutText(fontIndex, fontSize, ImVec2(x, y), text, placed);
+
+    for (const auto& item : placed)
     {
-        const ImFontGlyph* glyph = font->FindGlyph(*c);
-        if (!glyph) continue;
+        // Glyphs land on whole pixels, like ImGui's own text, so the cached bitmap can be copied row by row
+        const GlyphBitmap& bitmap = AcquireGlyphBitmap(fontIndex, fontSize, item.codepoint, *item.glyph);
+        int left = (int)std::round(item.origin.x) + bitmap.offsetX;
+        int top = (int)std::round(item.origin.y) + bitmap.offsetY;
+
+        int x0 = std::max(left, 0);
+        int x1 = std::min(left + bitmap.width, bufferWidth);
+        int y0 = std::max(top, 0);
+        int y1 = std::min(top + bitmap.height, bufferHeight);
+        if (x0 >= x1)
+        {
+            continue;
+        }
+        for (int py = y0; py < y1; py++)
+        {
+            MaxSpan(&coverage[(size_t)py * bufferWidth + x0],
+                    &bitmap.coverage[(size_t)(py - top) * bitmap.width + (x0 - left)], x1 - x0);
+        }
+    }
+}
 
-        float char_x = x + glyph->X0 * (fontSize / font->FontSize);
-        float char_y = y + glyph->Y0 * (fontSize / font->FontSize);
-        float char_w = (glyph->X1 - glyph->X0) * (fontSize / font->FontSize);
-        float char_h = (glyph->Y1 - glyph->Y0) * (fontSize / font->FontSize);
+// One dimensional squared distance transform (Felzenszwalb & Huttenlocher), in place over a strided line
+void SquaredDistanceTransform1D(float* values, int count, int stride, std::vector<float>& f, std::vector<int>& v, std::vector<float>& z)
+{
+    const float infinity = 1e20f;
+    for (int q = 0; q < count; ++q)
+    {
+        f[q] = values[(size_t)q * stride];
+    }
 
-        float tex_u0 = glyph->U0 * atlas->TexWidth;
-        float tex_v0 = glyph->V0 * atlas->TexHeight;
-        float tex_u1 = glyph->U1 * atlas->TexWidth;
-        float tex_v1 = glyph->V1 * atlas->TexHeight;
+    int k = 0;
+    v[0] = 0;
+    z[0] = -infinity;
+    z[1] = infinity;
+    for (int q = 1; q < count; ++q)
+    {
+        float s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        while (s <= z[k])
+        {
+            k--;
+            s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = infinity;
+    }
 
-        for (int py = 0; py < char_h; py++)
+    k = 0;
+    for (int q = 0; q < count; ++q)
+    {
+        while (z[k + 1] < q)
         {
-            for (int px = 0; px < char_w; px++)
-            {
-                int buffer_x = (int)(char_x + px);
-                int buffer_y = (int)(char_y + py);
-                if (buffer_x < 0 || buffer_x >= bufferWidth || buffer_y < 0 || buffer_y >= bufferHeight)
-                    continue;
-
-                int tex_x = (int)(tex_u0 + (tex_u1 - tex_u0) * (px / char_w));
-                int tex_y = (int)(tex_v0 + (tex_v1 - tex_v0) * (py / char_h));
-                int tex_index = (tex_y * atlas->TexWidth + tex_x) * 4;
-
-                float alpha = atlas->TexPixelsAlpha8[tex_y * atlas->TexWidth + tex_x] / 255.0f;
-
-                int buffer_index = (buffer_y * bufferWidth + buffer_x) * 4;
-                buffer[buffer_index] = (unsigned char)(color.x * 255.0f * alpha);
-                buffer[buffer_index + 1] = (unsigned char)(color.y * 255.0f * alpha);
-                buffer[buffer_index + 2] = (unsigned char)(color.z * 255.0f * alpha);
-                buffer[buffer_index + 3] = (unsigned char)(color.w * 255.0f * alpha);
-            }
+            k++;
         }
+        float offset = (float)(q - v[k]);
+        values[(size_t)q * stride] = offset * offset + f[v[k]];
+    }
+}
+
+// Euclidean distance in pixels from every pixel to the nearest covered pixel (or, with inside set, to the nearest
+// uncovered one). Linear in the pixel count, however far the distances reach.
+std::vector<float> DistanceToCoverage(const std::vector<unsigned char>& coverage, int width, int height, bool inside)
+{
+    const float infinity = 1e20f;
+    std::vector<float> distance((size_t)width * height);
+    for (size_t i = 0; i < distance.size(); ++i)
+    {
+        bool covered = coverage[i] >= 128;
+        distance[i] = covered != inside ? 0.0f : infinity;
+    }
+
+    int longest = std::max(width, height);
+    std::vector<float> f(longest);
+    std::vector<int> v(longest);
+    std::vector<float> z(longest + 1);
+    for (int x = 0; x < width; ++x)
+    {
+        SquaredDistanceTransform1D(&distance[x], height, width, f, v, z);
+    }
+    for (int y = 0; y < height; ++y)
+    {
+        SquaredDistanceTransform1D(&distance[(size_t)y * width], width, 1, f, v, z);
+    }
 
-        x += glyph->AdvanceX * (fontSize / font->FontSize);
+    for (auto& value : distance)
+    {
+        value = std::sqrt(value);
     }
+    return distance;
 }
 
 void DrawTriangle(std::vector<unsigned char>& buffer, int width, int height, ImVec2 pos[3], ImVec4 col)
@@ -221,255 +815,2865 @@ float Sign(ImVec2 p1, ImVec2 p2, ImVec2 p3)
     return (p1.x - p3.x) * (p2.y - p3.y) - (p2.x - p3.x) * (p1.y - p3.y);
 }
 
-void LoadFonts()
+// 64-bit FNV-1a
+uint64_t HashBytes(const std::vector<unsigned char>& bytes)
 {
-    ImGuiIO& io = ImGui::GetIO();
-    
-    // Clear any existing fonts
-    io.Fonts->Clear();
-    loadedFonts.clear();
-    fontNames.clear();
-
-    // Configure font loading
-    ImFontConfig config;
-    config.OversampleH = 4;
-    config.OversampleV = 4;
-    config.PixelSnapH = false;
-
-    // Load the default font with increased size
-    float baseFontSize = 24.0f; // Increase this for higher resolution
-    ImFont* defaultFont = io.Fonts->AddFontDefault(&config);
-    if (defaultFont)
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char byte : bytes)
     {
-        loadedFonts.push_back(defaultFont);
-        fontNames.push_back("Default");
-        std::cout << "Loaded default font" << std::endl;
+        hash = (hash ^ byte) * 1099511628211ull;
     }
-    else
+    return hash;
+}
+
+// Reads and parses a font file the first time one of its glyphs is needed
+FontFace* AcquireFontFace(int fontIndex)
+{
+    if (fontIndex < 0 || fontIndex >= (int)fontFaces.size())
     {
-        std::cerr << "Failed to load default font" << std::endl;
+        return nullptr;
     }
 
-    // Load your custom fonts
-    for (const auto& entry : std::filesystem::directory_iterator("fonts"))
+    FontFace& face = fontFaces[fontIndex];
+    if (!face.loaded && !face.failed)
     {
-        if (entry.path().extension() == ".ttf")
+        if (!face.path.empty())
         {
-            std::string fontPath = entry.path().string();
-            std::string fontName = entry.path().stem().string();
-            
-            ImFont* font = io.Fonts->AddFontFromFileTTF(fontPath.c_str(), baseFontSize, &config);
-            if (font != nullptr)
-            {
-                loadedFonts.push_back(font);
-                fontNames.push_back(fontName);
-                std::cout << "Loaded font: " << fontName << std::endl;
-            }
-            else
-            {
-                std::cerr << "Failed to load font: " << fontName << std::endl;
-            }
+            std::ifstream file(face.path, std::ios::binary);
+            face.fileData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
         }
-    }
 
-    // Rebuild font atlas
-    io.Fonts->Build();
+        const unsigned char* data = face.fileData.data();
+        if (face.fileData.empty() || !stbtt_InitFont(&face.info, data, stbtt_GetFontOffsetForIndex(data, 0)))
+        {
+            std::cerr << "Failed to load font: " << face.name << std::endl;
+            face.failed = true;
+            return nullptr;
+        }
 
-    std::cout << "Total fonts loaded: " << loadedFonts.size() << std::endl;
-}
+        int ascent, descent, lineGap;
+        stbtt_GetFontVMetrics(&face.info, &ascent, &descent, &lineGap);
+        face.scale = stbtt_ScaleForPixelHeight(&face.info, sdfFontSize);
+        face.ascent = std::round(ascent * face.scale);
+        face.hash = HashBytes(face.fileData);
+        face.loaded = true;
 
-void RenderTextWithStroke(ImDrawList* draw_list, const ImFont* font, float font_size, ImVec2 pos, ImU32 fill_col, ImU32 stroke_col, float stroke_width, const char* text, const char* text_end = NULL)
-{
-    if (stroke_width > 0)
-    {
-        for (float x = -stroke_width; x <= stroke_width; x += 1.0f)
+        // Reuse the glyphs rasterized in earlier sessions, unless the font file changed since
+        if (!face.cachedGlyphs.empty() && face.cachedHash == face.hash)
         {
-            for (float y = -stroke_width; y <= stroke_width; y += 1.0f)
-            {
-                draw_list->AddText(font, font_size, ImVec2(pos.x + x, pos.y + y), stroke_col, text, text_end);
-            }
+            face.glyphs.insert(face.cachedGlyphs.begin(), face.cachedGlyphs.end());
+            std::cout << "Loaded font: " << face.name << " (" << face.cachedGlyphs.size() << " cached glyphs)" << std::endl;
         }
+        else
+        {
+            glyphCacheStale = glyphCacheStale || !face.cachedGlyphs.empty();
+            std::cout << "Loaded font: " << face.name << std::endl;
+        }
+        face.cachedGlyphs.clear();
     }
-    draw_list->AddText(font, font_size, pos, fill_col, text, text_end);
+    return face.loaded ? &face : nullptr;
 }
 
-
-// Add this function to draw the grid
-void DrawGrid(ImDrawList* draw_list, const ImVec2& windowPos, const ImVec2& windowSize)
+GlyphPage& AddGlyphPage()
 {
-    // Draw background
-    draw_list->AddRectFilled(windowPos, ImVec2(windowPos.x + windowSize.x, windowPos.y + windowSize.y), IM_COL32(18, 18, 28, 255));
-
-    const float baseSpacing = 36.0f; // Base spacing between dots
-    const float baseSize = 1.0f; // Base size of dots
-    const ImU32 dotColor = IM_COL32(179, 179, 204, 255);
-
-    float spacing = baseSpacing * gridScale;
-    float size = baseSize * gridScale;
+    GlyphPage page;
+    page.storage.assign((size_t)glyphPageSize * glyphPageSize, 0);
+    page.pixels = page.storage.data();
+    page.shelfX = 1;
+    page.shelfY = 1;
+    page.shelfHeight = 0;
+    page.dirtyMinY = glyphPageSize;
+    page.dirtyMaxY = 0;
+    page.texture = 0; // Created on the main thread by EnsureGlyphPageTexture
+
+    glyphPages.push_back(std::move(page));
+    std::cout << "Added glyph atlas page " << glyphPages.size() << std::endl;
+    return glyphPages.back();
+}
 
-    // Implement a more balanced culling
-    const int maxDotsPerDimension = 300; // Increased for more detail
-    const float minSpacing = 10.0f; // Minimum spacing between dots
+// Finds room for a width x height field, keeping a one texel gap so bilinear sampling never reaches a neighbour
+bool AllocateGlyphRect(int width, int height, int& pageIndex, int& x, int& y)
+{
+    if (width + 2 > glyphPageSize || height + 2 > glyphPageSize)
+    {
+        return false;
+    }
 
-    if (spacing < minSpacing)
+    GlyphPage* page = glyphPages.empty() ? nullptr : &glyphPages.back();
+    if (page && page->shelfX + width + 1 > glyphPageSize)
     {
-        int factor = static_cast<int>(minSpacing / spacing) + 1;
-        spacing *= factor;
-        size *= std::sqrt(factor); // Increase dot size when spacing increases
+        page->shelfY += page->shelfHeight;
+        page->shelfX = 1;
+        page->shelfHeight = 0;
+    }
+    if (!page || page->shelfY + height + 1 > glyphPageSize)
+    {
+        page = &AddGlyphPage();
     }
 
-    // Ensure a minimum visible size for dots
-    const float minVisibleSize = 0.5f;
-    size = std::max(size, minVisibleSize);
+    pageIndex = (int)glyphPages.size() - 1;
+    x = page->shelfX;
+    y = page->shelfY;
+    page->shelfX += width + 1;
+    page->shelfHeight = std::max(page->shelfHeight, height + 1);
+    return true;
+}
 
-    ImVec2 offset = ImVec2(
-        fmodf(gridOffset.x, spacing),
-        fmodf(gridOffset.y, spacing)
-    );
+// Returns the glyph for a codepoint, rasterizing its distance field into the atlas on first use
+const Glyph* AcquireGlyph(FontFace& face, unsigned int codepoint)
+{
+    auto found = face.glyphs.find(codepoint);
+    if (found != face.glyphs.end())
+    {
+        return &found->second;
+    }
 
-    int dotsDrawn = 0;
-    for (float x = offset.x - spacing; x < windowSize.x + spacing; x += spacing)
+    Glyph glyph = {};
+    glyph.page = -1;
+    int glyphIndex = stbtt_FindGlyphIndex(&face.info, (int)codepoint);
+    int advance, leftSideBearing;
+    stbtt_GetGlyphHMetrics(&face.info, glyphIndex, &advance, &leftSideBearing);
+    glyph.advance = advance * face.scale;
+
+    int width, height, xoff, yoff;
+    unsigned char* field = stbtt_GetGlyphSDF(&face.info, face.scale, glyphIndex, sdfSpread, 128, 128.0f / sdfSpread,
+                                             &width, &height, &xoff, &yoff);
+    if (field)
     {
-        for (float y = offset.y - spacing; y < windowSize.y + spacing; y += spacing)
+        if (AllocateGlyphRect(width, height, glyph.page, glyph.x, glyph.y))
         {
-            draw_list->AddCircleFilled(
-                ImVec2(windowPos.x + x, windowPos.y + y),
-                size / 2,
-                dotColor
-            );
-
-            dotsDrawn++;
-            if (dotsDrawn > maxDotsPerDimension * maxDotsPerDimension)
+            GlyphPage& page = glyphPages[glyph.page];
+            for (int row = 0; row < height; ++row)
             {
-                goto endDrawing; // Exit both loops if we've drawn too many dots
+                std::copy(field + row * width, field + (row + 1) * width,
+                          &page.pixels[(size_t)(glyph.y + row) * glyphPageSize + glyph.x]);
             }
+            page.dirtyMinY = std::min(page.dirtyMinY, glyph.y);
+            page.dirtyMaxY = std::max(page.dirtyMaxY, glyph.y + height);
+
+            glyph.width = width;
+            glyph.height = height;
+            glyph.offsetX = (float)xoff;
+            glyph.offsetY = face.ascent + yoff;
         }
+        stbtt_FreeSDF(field, nullptr);
     }
 
-endDrawing:
-    // You can add any cleanup or final operations here if needed
+    glyphCacheDirty = true;
+    return &face.glyphs.emplace(codepoint, glyph).first->second;
 }
 
-GLuint CreateTextureFromData(const std::vector<unsigned char>& data, int width, int height)
+// Creates the page's texture with everything written so far. Main thread only.
+void EnsureGlyphPageTexture(GlyphPage& page)
 {
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    if (page.texture != 0)
+    {
+        return;
+    }
+    glGenTextures(1, &page.texture);
+    glBindTexture(GL_TEXTURE_2D, page.texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-    return texture;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, glyphPageSize, glyphPageSize, 0, GL_ALPHA, GL_UNSIGNED_BYTE, page.pixels);
+    page.dirtyMinY = glyphPageSize;
+    page.dirtyMaxY = 0;
+}
+
+// Uploads the rows of each atlas page that received new glyphs this frame
+void FlushGlyphPages()
+{
+    std::lock_guard<std::mutex> lock(glyphMutex);
+    for (auto& page : glyphPages)
+    {
+        if (page.texture == 0 || page.dirtyMinY >= page.dirtyMaxY)
+        {
+            continue;
+        }
+        glBindTexture(GL_TEXTURE_2D, page.texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, page.dirtyMinY, glyphPageSize, page.dirtyMaxY - page.dirtyMinY,
+                        GL_ALPHA, GL_UNSIGNED_BYTE, &page.pixels[(size_t)page.dirtyMinY * glyphPageSize]);
+        page.dirtyMinY = glyphPageSize;
+        page.dirtyMaxY = 0;
+    }
+}
+
+// Decodes one UTF-8 sequence and returns its length; stray bytes decode as themselves
+int DecodeUtf8(const char* text, unsigned int& codepoint)
+{
+    const unsigned char* bytes = (const unsigned char*)text;
+    int length = bytes[0] < 0x80 ? 1 : (bytes[0] >> 5) == 0x6 ? 2 : (bytes[0] >> 4) == 0xE ? 3 : (bytes[0] >> 3) == 0x1E ? 4 : 0;
+    if (length == 0)
+    {
+        codepoint = bytes[0];
+        return 1;
+    }
+
+    codepoint = length == 1 ? bytes[0] : bytes[0] & (0x7F >> length);
+    for (int i = 1; i < length; ++i)
+    {
+        if ((bytes[i] & 0xC0) != 0x80)
+        {
+            codepoint = bytes[0];
+            return 1;
+        }
+        codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+    }
+    return length;
+}
+
+// Places the glyph quads of the text with its top-left at pos. Lines are fontSize apart, like ImGui's text.
+void LayoutText(int fontIndex, float fontSize, ImVec2 pos, const char* text, std::vector<PlacedGlyph>& placed)
+{
+    placed.clear();
+    FontFace* face = AcquireFontFace(fontIndex);
+    if (!face)
+    {
+        return;
+    }
+
+    float scale = fontSize / sdfFontSize;
+    float x = pos.x;
+    float y = pos.y;
+    for (const char* c = text; *c != '\0';)
+    {
+        unsigned int codepoint;
+        c += DecodeUtf8(c, codepoint);
+        if (codepoint == '\n')
+        {
+            x = pos.x;
+            y += fontSize;
+            continue;
+        }
+        if (codepoint == '\r')
+        {
+            continue;
+        }
+        if (codepoint == '\t')
+        {
+            x += AcquireGlyph(*face, ' ')->advance * scale * 4;
+            continue;
+        }
+
+        const Glyph* glyph = AcquireGlyph(*face, codepoint);
+        if (glyph->page >= 0)
+        {
+            ImVec2 min(x + glyph->offsetX * scale, y + glyph->offsetY * scale);
+            ImVec2 max(min.x + glyph->width * scale, min.y + glyph->height * scale);
+            placed.push_back({ glyph, codepoint, ImVec2(x, y), min, max });
+        }
+        x += glyph->advance * scale;
+    }
+}
+
+ImVec2 MeasureText(int fontIndex, float fontSize, const char* text)
+{
+    std::lock_guard<std::mutex> lock(glyphMutex);
+    FontFace* face = AcquireFontFace(fontIndex);
+    if (!face)
+    {
+        return ImVec2(0, 0);
+    }
+
+    float scale = fontSize / sdfFontSize;
+    float lineWidth = 0.0f;
+    ImVec2 size(0.0f, fontSize);
+    for (const char* c = text; *c != '\0';)
+    {
+        unsigned int codepoint;
+        c += DecodeUtf8(c, codepoint);
+        if (codepoint == '\n')
+        {
+            size.x = std::max(size.x, lineWidth);
+            size.y += fontSize;
+            lineWidth = 0.0f;
+        }
+        else if (codepoint == '\t')
+        {
+            lineWidth += AcquireGlyph(*face, ' ')->advance * scale * 4;
+        }
+        else if (codepoint != '\r')
+        {
+            lineWidth += AcquireGlyph(*face, codepoint)->advance * scale;
+        }
+    }
+    size.x = std::max(size.x, lineWidth);
+    return size;
+}
+
+struct GlyphCacheHeader {
+    char magic[4];
+    uint32_t version;
+    float fontSize;
+    int32_t spread;
+    int32_t pageSize;
+    int32_t pageCount;
+    int32_t faceCount;
+    uint64_t pixelOffset; // Page pixels start here, aligned so each page can be mapped on its own
+};
+
+bool ReadCacheBytes(const unsigned char*& cursor, const unsigned char* end, void* out, size_t size)
+{
+    if ((size_t)(end - cursor) < size)
+    {
+        return false;
+    }
+    std::memcpy(out, cursor, size);
+    cursor += size;
+    return true;
+}
+
+// Maps the glyph cache written by the last session. The mapping is private and writable, so new
+// glyphs can still be added to the last page; only the touched memory pages get copied.
+void LoadGlyphCache()
+{
+    int fd = open(glyphCachePath, O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(GlyphCacheHeader))
+    {
+        close(fd);
+        return;
+    }
+    void* mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "Failed to map glyph cache: " << glyphCachePath << std::endl;
+        return;
+    }
+
+    const unsigned char* begin = (const unsigned char*)mapping;
+    const unsigned char* end = begin + info.st_size;
+    const unsigned char* cursor = begin;
+    GlyphCacheHeader header;
+    ReadCacheBytes(cursor, end, &header, sizeof(header));
+    size_t pageBytes = (size_t)glyphPageSize * glyphPageSize;
+    bool valid = std::memcmp(header.magic, "GLYC", 4) == 0 && header.version == glyphCacheVersion &&
+                 header.fontSize == sdfFontSize && header.spread == sdfSpread && header.pageSize == glyphPageSize &&
+                 header.pageCount >= 0 && header.faceCount >= 0 &&
+                 header.pixelOffset + header.pageCount * pageBytes <= (uint64_t)info.st_size;
+
+    std::vector<int32_t> shelves(valid ? header.pageCount * 3 : 0);
+    valid = valid && ReadCacheBytes(cursor, end, shelves.data(), shelves.size() * sizeof(int32_t));
+    for (size_t i = 0; valid && i < shelves.size(); ++i)
+    {
+        valid = shelves[i] >= 0 && shelves[i] <= glyphPageSize;
+    }
+
+    std::vector<FontFace*> faces;
+    for (int i = 0; valid && i < header.faceCount; ++i)
+    {
+        uint32_t nameLength = 0, glyphCount = 0;
+        uint64_t hash = 0;
+        valid = ReadCacheBytes(cursor, end, &nameLength, sizeof(nameLength)) && nameLength <= (uint32_t)(end - cursor);
+        if (!valid) break;
+        std::string name((const char*)cursor, nameLength);
+        cursor += nameLength;
+        valid = ReadCacheBytes(cursor, end, &hash, sizeof(hash)) && ReadCacheBytes(cursor, end, &glyphCount, sizeof(glyphCount));
+
+        auto face = std::find_if(fontFaces.begin(), fontFaces.end(), [&](const FontFace& f) { return f.name == name; });
+        std::vector<std::pair<unsigned int, Glyph>> glyphs(valid ? glyphCount : 0);
+        for (auto& entry : glyphs)
+        {
+            uint32_t codepoint;
+            valid = valid && ReadCacheBytes(cursor, end, &codepoint, sizeof(codepoint)) &&
+                    ReadCacheBytes(cursor, end, &entry.second, sizeof(Glyph));
+            // The rectangle is sampled bilinearly from page memory later, so it must lie inside its page
+            // and be at least two texels each way
+            const Glyph& glyph = entry.second;
+            valid = valid && (glyph.page == -1 ||
+                    (glyph.page >= 0 && glyph.page < header.pageCount &&
+                     glyph.x >= 0 && glyph.y >= 0 && glyph.width >= 2 && glyph.height >= 2 &&
+                     glyph.x <= glyphPageSize - glyph.width && glyph.y <= glyphPageSize - glyph.height));
+            entry.first = codepoint;
+        }
+        if (valid && face != fontFaces.end())
+        {
+            face->cachedHash = hash;
+            face->cachedGlyphs = std::move(glyphs);
+            faces.push_back(&*face);
+        }
+        else if (valid && glyphCount > 0)
+        {
+            // The font is gone; its glyphs would be carried forward forever
+            glyphCacheStale = true;
+        }
+    }
+
+    if (!valid)
+    {
+        std::cerr << "Ignoring stale or damaged glyph cache: " << glyphCachePath << std::endl;
+        for (FontFace* face : faces)
+        {
+            face->cachedGlyphs.clear();
+        }
+        munmap(mapping, (size_t)info.st_size);
+        return;
+    }
+
+    glyphCacheMapping = mapping;
+    glyphCacheMappingSize = (size_t)info.st_size;
+    for (int i = 0; i < header.pageCount; ++i)
+    {
+        GlyphPage page;
+        page.pixels = (unsigned char*)mapping + header.pixelOffset + i * pageBytes;
+        page.shelfX = shelves[i * 3];
+        page.shelfY = shelves[i * 3 + 1];
+        page.shelfHeight = shelves[i * 3 + 2];
+        page.dirtyMinY = glyphPageSize;
+        page.dirtyMaxY = 0;
+        page.texture = 0; // Uploaded the first time the page is drawn from
+        glyphPages.push_back(std::move(page));
+    }
+    std::cout << "Mapped glyph cache: " << header.pageCount << " page(s), " << faces.size() << " font(s)" << std::endl;
+}
+
+// Writes the atlas back if this session rasterized anything new, then releases the mapping
+void CloseGlyphCache()
+{
+    if (glyphCacheStale)
+    {
+        // The pages hold glyphs nothing refers to any more. Rather than write them back, start the
+        // atlas over next launch so the file doesn't keep growing.
+        std::error_code error;
+        std::filesystem::remove(glyphCachePath, error);
+        std::cout << "Discarded stale glyph cache: " << glyphCachePath << std::endl;
+    }
+    else if (glyphCacheDirty)
+    {
+        size_t pageBytes = (size_t)glyphPageSize * glyphPageSize;
+        std::string tempPath = std::string(glyphCachePath) + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary);
+
+        GlyphCacheHeader header = {};
+        std::memcpy(header.magic, "GLYC", 4);
+        header.version = glyphCacheVersion;
+        header.fontSize = sdfFontSize;
+        header.spread = sdfSpread;
+        header.pageSize = glyphPageSize;
+        header.pageCount = (int32_t)glyphPages.size();
+        header.faceCount = 0;
+        file.write((const char*)&header, sizeof(header));
+
+        for (const auto& page : glyphPages)
+        {
+            int32_t shelf[3] = { page.shelfX, page.shelfY, page.shelfHeight };
+            file.write((const char*)shelf, sizeof(shelf));
+        }
+
+        // Fonts this session never touched keep the entries they had in the old cache
+        for (const auto& face : fontFaces)
+        {
+            bool fromCache = !face.loaded && !face.cachedGlyphs.empty();
+            if (!face.loaded && !fromCache)
+            {
+                continue;
+            }
+            uint32_t nameLength = (uint32_t)face.name.size();
+            uint64_t hash = face.loaded ? face.hash : face.cachedHash;
+            uint32_t glyphCount = (uint32_t)(face.loaded ? face.glyphs.size() : face.cachedGlyphs.size());
+            file.write((const char*)&nameLength, sizeof(nameLength));
+            file.write(face.name.data(), nameLength);
+            file.write((const char*)&hash, sizeof(hash));
+            file.write((const char*)&glyphCount, sizeof(glyphCount));
+            auto writeGlyph = [&](uint32_t codepoint, const Glyph& glyph) {
+                file.write((const char*)&codepoint, sizeof(codepoint));
+                file.write((const char*)&glyph, sizeof(Glyph));
+            };
+            if (face.loaded)
+            {
+                for (const auto& entry : face.glyphs) writeGlyph(entry.first, entry.second);
+            }
+            else
+            {
+                for (const auto& entry : face.cachedGlyphs) writeGlyph(entry.first, entry.second);
+            }
+            header.faceCount++;
+        }
+
+        // Page-align the pixels and patch the header now that its counts are known
+        header.pixelOffset = ((uint64_t)file.tellp() + 4095) & ~(uint64_t)4095;
+        std::vector<char> alignment((size_t)(header.pixelOffset - (uint64_t)file.tellp()), 0);
+        file.write(alignment.data(), alignment.size());
+        for (const auto& page : glyphPages)
+        {
+            file.write((const char*)page.pixels, pageBytes);
+        }
+        file.seekp(0);
+        file.write((const char*)&header, sizeof(header));
+        file.close();
+
+        // Replace the old file only once the new one is complete; the old mapping stays valid meanwhile
+        std::error_code error;
+        if (file)
+        {
+            std::filesystem::rename(tempPath, glyphCachePath, error);
+        }
+        if (!file || error)
+        {
+            std::cerr << "Failed to write glyph cache: " << glyphCachePath << std::endl;
+            std::filesystem::remove(tempPath, error);
+        }
+        glyphCacheDirty = false;
+    }
+
+    if (glyphCacheMapping)
+    {
+        munmap(glyphCacheMapping, glyphCacheMappingSize);
+        glyphCacheMapping = nullptr;
+    }
+}
+
+FontFace MakeFontFace(const std::string& name, const std::string& path)
+{
+    FontFace face;
+    face.name = name;
+    face.path = path;
+    face.info = {};
+    face.loaded = false;
+    face.failed = false;
+    face.scale = 1.0f;
+    face.ascent = 0.0f;
+    face.hash = 0;
+    face.cachedHash = 0;
+    return face;
+}
+
+// Only the UI font goes into ImGui's atlas. Canvas fonts are just registered here; their files are
+// read when a text first uses them and their glyphs rasterized as they are drawn.
+void LoadFonts()
+{
+    ImGuiIO& io = ImGui::GetIO();
+    
+    // Clear any existing fonts
+    io.Fonts->Clear();
+    fontFaces.clear();
+    fontNames.clear();
+
+    // Configure font loading
+    ImFontConfig config;
+    config.OversampleH = 4;
+    config.OversampleV = 4;
+    config.PixelSnapH = false;
+
+    ImFont* defaultFont = io.Fonts->AddFontDefault(&config);
+    if (defaultFont)
+    {
+        // Keep a copy of the built-in font's TTF data so canvas text can use it too
+        const ImFontConfig& source = io.Fonts->ConfigData.back();
+        FontFace face = MakeFontFace("Default", "");
+        face.fileData.assign((const unsigned char*)source.FontData, (const unsigned char*)source.FontData + source.FontDataSize);
+        fontFaces.push_back(std::move(face));
+        fontNames.push_back("Default");
+    }
+    else
+    {
+        std::cerr << "Failed to load default font" << std::endl;
+    }
+
+    // Register your custom fonts
+    for (const auto& entry : std::filesystem::directory_iterator("fonts"))
+    {
+        if (entry.path().extension() == ".ttf")
+        {
+            std::string fontName = entry.path().stem().string();
+            fontFaces.push_back(MakeFontFace(fontName, entry.path().string()));
+            fontNames.push_back(fontName);
+        }
+    }
+
+    // Rebuild font atlas
+    io.Fonts->Build();
+
+    std::cout << "Total fonts registered: " << fontFaces.size() << std::endl;
+}
+
+void RenderTextWithStroke(ImDrawList* draw_list, const ImFont* font, float font_size, ImVec2 pos, ImU32 fill_col, ImU32 stroke_col, float stroke_width, const char* text, const char* text_end = NULL)
+{
+    if (stroke_width > 0)
+    {
+        for (float x = -stroke_width; x <= stroke_width; x += 1.0f)
+        {
+            for (float y = -stroke_width; y <= stroke_width; y += 1.0f)
+            {
+                draw_list->AddText(font, font_size, ImVec2(pos.x + x, pos.y + y), stroke_col, text, text_end);
+            }
+        }
+    }
+    draw_list->AddText(font, font_size, pos, fill_col, text, text_end);
+}
+
+
+bool SameColor(const ImVec4& a, const ImVec4& b)
+{
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+void ReleaseTextCache(Text& text)
+{
+    if (text.cacheTexture != 0)
+    {
+        glDeleteTextures(1, &text.cacheTexture);
+        text.cacheTexture = 0;
+    }
+}
+
+// Re-renders the text's texture if its content, font, size or colors changed since the last frame
+void UpdateTextCache(Text& text)
+{
+    if (text.cacheTexture != 0 &&
+        text.cacheContent == text.content &&
+        text.cacheFontIndex == text.fontIndex &&
+        text.cacheSize == text.size &&
+        text.cacheStrokeWidth == text.strokeWidth &&
+        SameColor(text.cacheFillColor, text.fillColor) &&
+        SameColor(text.cacheStrokeColor, text.strokeColor))
+    {
+        return;
+    }
+
+    ReleaseTextCache(text);
+    text.cacheContent = text.content;
+    text.cacheFontIndex = text.fontIndex;
+    text.cacheSize = text.size;
+    text.cacheFillColor = text.fillColor;
+    text.cacheStrokeColor = text.strokeColor;
+    text.cacheStrokeWidth = text.strokeWidth;
+    if (text.content.empty())
+    {
+        return;
+    }
+
+    std::vector<unsigned char> pixels = RenderTextToPixels(text.content.c_str(), text.fontIndex, text.size,
+                                                           text.fillColor, text.strokeColor, text.strokeWidth,
+                                                           text.cacheWidth, text.cacheHeight);
+    text.cacheTexture = CreateTextureFromData(pixels, text.cacheWidth, text.cacheHeight);
+}
+
+// Draws the cached rendering as a single quad. pos is where AddText would have placed the text.
+void DrawCachedText(ImDrawList* draw_list, Text& text, ImVec2 pos, float scale)
+{
+    UpdateTextCache(text);
+    if (text.cacheTexture == 0)
+    {
+        return;
+    }
+
+    // RenderTextToPixels pads the text by strokeWidth + 5 on each side
+    float padding = (text.strokeWidth + 5) * scale;
+    ImVec2 min(pos.x - padding, pos.y - padding);
+    ImVec2 max(min.x + text.cacheWidth * scale, min.y + text.cacheHeight * scale);
+    draw_list->AddImage((void*)(intptr_t)text.cacheTexture, min, max);
+}
+
+
+// GL_GENERATE_MIPMAP is core since GL 1.4, and unlike glGenerateMipmap it is available in our 2.1 context.
+// It also rebuilds the chain whenever level 0 changes through glTexSubImage2D.
+bool HasAutoMipmapGeneration()
+{
+    static int supported = -1;
+    if (supported == -1)
+    {
+        int major = 0, minor = 0;
+        const char* version = (const char*)glGetString(GL_VERSION);
+        if (version)
+        {
+            sscanf(version, "%d.%d", &major, &minor);
+        }
+        supported = (major > 1 || (major == 1 && minor >= 4)) ? 1 : 0;
+        std::cout << "Mipmap generation: " << (supported ? "GPU" : "CPU") << std::endl;
+    }
+    return supported == 1;
+}
+
+// Halves an RGBA image with a 2x2 box filter, writing only the [x0,x1)x[y0,y1) part of the destination.
+// Colors are weighted by alpha so transparent pixels don't bleed dark fringes into the smaller levels.
+void DownsampleRGBARegion(const std::vector<unsigned char>& src, int width, int height,
+                          std::vector<unsigned char>& dst, int outWidth, int x0, int y0, int x1, int y1)
+{
+    for (int y = y0; y < y1; ++y)
+    {
+        int sy0 = std::min(y * 2, height - 1);
+        int sy1 = std::min(y * 2 + 1, height - 1);
+        for (int x = x0; x < x1; ++x)
+        {
+            int sx0 = std::min(x * 2, width - 1);
+            int sx1 = std::min(x * 2 + 1, width - 1);
+            const unsigned char* p[4] = {
+                &src[((size_t)sy0 * width + sx0) * 4], &src[((size_t)sy0 * width + sx1) * 4],
+                &src[((size_t)sy1 * width + sx0) * 4], &src[((size_t)sy1 * width + sx1) * 4]
+            };
+
+            int alphaSum = p[0][3] + p[1][3] + p[2][3] + p[3][3];
+            unsigned char* out = &dst[((size_t)y * outWidth + x) * 4];
+            for (int c = 0; c < 3; ++c)
+            {
+                if (alphaSum > 0)
+                {
+                    out[c] = (unsigned char)((p[0][c] * p[0][3] + p[1][c] * p[1][3] + p[2][c] * p[2][3] + p[3][c] * p[3][3]) / alphaSum);
+                }
+                else
+                {
+                    out[c] = (unsigned char)((p[0][c] + p[1][c] + p[2][c] + p[3][c]) / 4);
+                }
+            }
+            out[3] = (unsigned char)((alphaSum + 2) / 4);
+        }
+    }
+}
+
+// Same as DownsampleRGBARegion for single-channel eraser masks
+void DownsampleMaskRegion(const std::vector<unsigned char>& src, int width, int height,
+                          std::vector<unsigned char>& dst, int outWidth, int x0, int y0, int x1, int y1)
+{
+    for (int y = y0; y < y1; ++y)
+    {
+        int sy0 = std::min(y * 2, height - 1);
+        int sy1 = std::min(y * 2 + 1, height - 1);
+        for (int x = x0; x < x1; ++x)
+        {
+            int sx0 = std::min(x * 2, width - 1);
+            int sx1 = std::min(x * 2 + 1, width - 1);
+            int sum = src[(size_t)sy0 * width + sx0] + src[(size_t)sy0 * width + sx1] +
+                      src[(size_t)sy1 * width + sx0] + src[(size_t)sy1 * width + sx1];
+            dst[(size_t)y * outWidth + x] = (unsigned char)((sum + 2) / 4);
+        }
+    }
+}
+
+int BytesPerPixel(GLenum format)
+{
+    return format == GL_ALPHA ? 1 : 4;
+}
+
+std::vector<unsigned char> DownsampleLevel(const std::vector<unsigned char>& src, int width, int height,
+                                           int& outWidth, int& outHeight, GLenum format)
+{
+    outWidth = std::max(1, width / 2);
+    outHeight = std::max(1, height / 2);
+    std::vector<unsigned char> dst((size_t)outWidth * outHeight * BytesPerPixel(format));
+    if (format == GL_ALPHA)
+    {
+        DownsampleMaskRegion(src, width, height, dst, outWidth, 0, 0, outWidth, outHeight);
+    }
+    else
+    {
+        DownsampleRGBARegion(src, width, height, dst, outWidth, 0, 0, outWidth, outHeight);
+    }
+    return dst;
+}
+
+// Fallback for drivers without GL_GENERATE_MIPMAP: builds the pyramid on the CPU and uploads every level
+void UploadMipChain(const std::vector<unsigned char>& data, int width, int height, bool allocate, GLenum format)
+{
+    const std::vector<unsigned char>* level = &data;
+    std::vector<unsigned char> scratch;
+    int levelWidth = width;
+    int levelHeight = height;
+    for (int mip = 0; ; ++mip)
+    {
+        if (allocate)
+        {
+            glTexImage2D(GL_TEXTURE_2D, mip, format, levelWidth, levelHeight, 0, format, GL_UNSIGNED_BYTE, level->data());
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, mip, 0, 0, levelWidth, levelHeight, format, GL_UNSIGNED_BYTE, level->data());
+        }
+
+        if (levelWidth == 1 && levelHeight == 1)
+        {
+            break;
+        }
+        int nextWidth, nextHeight;
+        scratch = DownsampleLevel(*level, levelWidth, levelHeight, nextWidth, nextHeight, format);
+        level = &scratch;
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+}
+
+GLuint CreateTextureFromData(const std::vector<unsigned char>& data, int width, int height, GLenum format)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    // Trilinear filtering: the sampler picks the mip level from the on-screen size, so zoomed-out
+    // images read from small levels instead of aliasing over the full-resolution texels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (HasAutoMipmapGeneration())
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data.data());
+    }
+    else
+    {
+        UploadMipChain(data, width, height, true, format);
+    }
+    return texture;
+}
+
+std::vector<unsigned char> CopyPixelRegion(const std::vector<unsigned char>& src, int srcWidth, int x, int y, int width, int height,
+                                           int bytesPerPixel = 4)
+{
+    std::vector<unsigned char> region((size_t)width * height * bytesPerPixel);
+    for (int row = 0; row < height; ++row)
+    {
+        std::copy_n(&src[((size_t)(y + row) * srcWidth + x) * bytesPerPixel], (size_t)width * bytesPerPixel,
+                    &region[(size_t)row * width * bytesPerPixel]);
+    }
+    return region;
+}
+
+// Re-uploads the [x0,x1)x[y0,y1) part of a texture's source buffer. The texture holds the
+// texWidth x texHeight window of the source that starts at (originX, originY).
+void UpdateTextureRegion(GLuint texture, const std::vector<unsigned char>& src, int srcWidth,
+                         int originX, int originY, int texWidth, int texHeight,
+                         int x0, int y0, int x1, int y1, GLenum format = GL_RGBA)
+{
+    x0 = std::max(x0, originX);
+    y0 = std::max(y0, originY);
+    x1 = std::min(x1, originX + texWidth);
+    y1 = std::min(y1, originY + texHeight);
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    int bytesPerPixel = BytesPerPixel(format);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (HasAutoMipmapGeneration())
+    {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, srcWidth);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x0 - originX, y0 - originY, x1 - x0, y1 - y0, format, GL_UNSIGNED_BYTE,
+                        &src[((size_t)y0 * srcWidth + x0) * bytesPerPixel]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+    else
+    {
+        // The CPU-built levels have to be rebuilt from the whole window
+        UploadMipChain(CopyPixelRegion(src, srcWidth, originX, originY, texWidth, texHeight, bytesPerPixel),
+                       texWidth, texHeight, false, format);
+    }
+}
+
+// Images above this size (or the driver limit) are split into tiles that are streamed in on demand
+const int textureTileSize = 1024;
+const int tiledImageThreshold = 4096;
+const int maxTileUploadsPerFrame = 4;
+GLint maxTextureSize = 4096;
+int tileUploadsThisFrame = 0;
+
+bool NeedsTiling(int width, int height)
+{
+    return std::max(width, height) > std::min<int>(tiledImageThreshold, maxTextureSize);
+}
+
+int LevelDimension(int size, int level)
+{
+    return std::max(1, size >> level);
+}
+
+const std::vector<unsigned char>& ImageLevelPixels(const Image& img, int level)
+{
+    return level == 0 ? *img.data : *img.pyramid[level - 1];
+}
+
+const std::vector<unsigned char>& MaskLevelPixels(const Image& img, int level)
+{
+    return level == 0 ? *img.mask : *img.maskPyramid[level - 1];
+}
+
+// Builds the downsampled levels of a huge image, down to the first one that fits in a single tile.
+// Runs on the decode workers.
+std::vector<std::vector<unsigned char>> BuildImagePyramid(const std::vector<unsigned char>& data, int width, int height)
+{
+    std::vector<std::vector<unsigned char>> pyramid;
+    const std::vector<unsigned char>* level = &data;
+    int levelWidth = width;
+    int levelHeight = height;
+    while (std::max(levelWidth, levelHeight) > textureTileSize)
+    {
+        int nextWidth, nextHeight;
+        pyramid.push_back(DownsampleLevel(*level, levelWidth, levelHeight, nextWidth, nextHeight, GL_RGBA));
+        level = &pyramid.back();
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+    return pyramid;
+}
+
+// The eraser never touches the pixels; it writes an 8-bit mask (255 = visible) that is multiplied into
+// the alpha at draw time. The mask is allocated on the first erase.
+void EnsureEraserMask(Image& img)
+{
+    if (img.mask)
+    {
+        return;
+    }
+    img.mask = std::make_shared<std::vector<unsigned char>>((size_t)img.width * img.height, 255);
+    img.maskPyramid.clear();
+    for (int level = 1; level <= img.previewLevel; ++level)
+    {
+        img.maskPyramid.push_back(std::make_shared<std::vector<unsigned char>>(
+            (size_t)LevelDimension(img.width, level) * LevelDimension(img.height, level), 255));
+    }
+}
+
+// Gives the image its own copy of any mask it shares with a copy or an undo snapshot, before writing
+void MakeMasksUnique(Image& img)
+{
+    if (img.mask && img.mask.use_count() > 1)
+    {
+        img.mask = std::make_shared<std::vector<unsigned char>>(*img.mask);
+    }
+    for (auto& level : img.maskPyramid)
+    {
+        if (level.use_count() > 1)
+        {
+            level = std::make_shared<std::vector<unsigned char>>(*level);
+        }
+    }
+    if (img.hitMask && img.hitMask.use_count() > 1)
+    {
+        img.hitMask = std::make_shared<std::vector<HitMaskLevel>>(*img.hitMask);
+    }
+}
+
+// Hit testing looks at a coarse map of where the image is opaque, so clicks through the transparent
+// parts of a cut-out reach the image underneath. Level 0 has one bit per hitMaskCellSize square of
+// pixels, set if any of them is visible; each further level ORs 2x2 cells of the one below.
+const int hitMaskCellSize = 4;
+const unsigned char hitAlphaThreshold = 16;  // Fainter pixels don't count as hits
+
+// True if any pixel of the block is opaque enough and not erased
+bool IsPixelBlockVisible(const std::vector<unsigned char>& pixels, const std::vector<unsigned char>& mask,
+                         int width, int x0, int y0, int x1, int y1)
+{
+    for (int y = y0; y < y1; ++y)
+    {
+        for (int x = x0; x < x1; ++x)
+        {
+            size_t index = (size_t)y * width + x;
+            if (pixels[index * 4 + 3] >= hitAlphaThreshold && (mask.empty() || mask[index] != 0))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool HitMaskBit(const HitMaskLevel& level, int x, int y)
+{
+    return (level.bits[(size_t)y * level.wordsPerRow + x / 64] >> (x % 64)) & 1;
+}
+
+void SetHitMaskBit(HitMaskLevel& level, int x, int y, bool value)
+{
+    uint64_t& word = level.bits[(size_t)y * level.wordsPerRow + x / 64];
+    uint64_t bit = (uint64_t)1 << (x % 64);
+    word = value ? (word | bit) : (word & ~bit);
+}
+
+// Recomputes the cells covering pixels [x0, x1) x [y0, y1) on every level
+void RefreshHitMask(std::vector<HitMaskLevel>& levels, const std::vector<unsigned char>& pixels,
+                    const std::vector<unsigned char>& mask, int width, int height, int x0, int y0, int x1, int y1)
+{
+    if (levels.empty())
+    {
+        return;
+    }
+    int cellMinX = x0 / hitMaskCellSize;
+    int cellMinY = y0 / hitMaskCellSize;
+    int cellMaxX = (x1 + hitMaskCellSize - 1) / hitMaskCellSize;
+    int cellMaxY = (y1 + hitMaskCellSize - 1) / hitMaskCellSize;
+    for (int cy = cellMinY; cy < cellMaxY; ++cy)
+    {
+        for (int cx = cellMinX; cx < cellMaxX; ++cx)
+        {
+            bool visible = IsPixelBlockVisible(pixels, mask, width,
+                cx * hitMaskCellSize, cy * hitMaskCellSize,
+                std::min((cx + 1) * hitMaskCellSize, width), std::min((cy + 1) * hitMaskCellSize, height));
+            SetHitMaskBit(levels[0], cx, cy, visible);
+        }
+    }
+
+    for (size_t l = 1; l < levels.size(); ++l)
+    {
+        const HitMaskLevel& below = levels[l - 1];
+        cellMinX /= 2;
+        cellMinY /= 2;
+        cellMaxX = (cellMaxX + 1) / 2;
+        cellMaxY = (cellMaxY + 1) / 2;
+        for (int cy = cellMinY; cy < cellMaxY; ++cy)
+        {
+            for (int cx = cellMinX; cx < cellMaxX; ++cx)
+            {
+                bool visible = false;
+                for (int y = cy * 2; y < std::min(cy * 2 + 2, below.height) && !visible; ++y)
+                {
+                    for (int x = cx * 2; x < std::min(cx * 2 + 2, below.width) && !visible; ++x)
+                    {
+                        visible = HitMaskBit(below, x, y);
+                    }
+                }
+                SetHitMaskBit(levels[l], cx, cy, visible);
+            }
+        }
+    }
+}
+
+// Runs on the decode workers for loaded files, and on the GL thread for text images
+std::vector<HitMaskLevel> BuildHitMask(const std::vector<unsigned char>& pixels, int width, int height)
+{
+    std::vector<HitMaskLevel> levels;
+    int levelWidth = (width + hitMaskCellSize - 1) / hitMaskCellSize;
+    int levelHeight = (height + hitMaskCellSize - 1) / hitMaskCellSize;
+    while (true)
+    {
+        HitMaskLevel level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.wordsPerRow = (levelWidth + 63) / 64;
+        level.bits.assign((size_t)level.wordsPerRow * levelHeight, 0);
+        levels.push_back(std::move(level));
+        if (levelWidth <= 1 && levelHeight <= 1)
+        {
+            break;
+        }
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+    RefreshHitMask(levels, pixels, std::vector<unsigned char>(), width, height, 0, 0, width, height);
+    return levels;
+}
+
+// Color textures are shared by every image drawn from the same pixel buffer: copies, and images
+// that undo or redo bring back. An image only uploads pixels that no texture holds yet.
+struct SharedTexture {
+    GLuint texture;
+    int references;
+    size_t bytes;  // Including the mip chain
+};
+
+std::unordered_map<const std::vector<unsigned char>*, SharedTexture> sharedTextures;
+
+GLuint AcquireSharedTexture(const std::vector<unsigned char>& pixels, int width, int height)
+{
+    auto found = sharedTextures.find(&pixels);
+    if (found != sharedTextures.end())
+    {
+        found->second.references++;
+        return found->second.texture;
+    }
+    GLuint texture = CreateTextureFromData(pixels, width, height);
+    sharedTextures[&pixels] = { texture, 1, (size_t)width * height * 4 * 4 / 3 };
+    return texture;
+}
+
+// The image holding the reference must still hold the buffer, since the buffer is the key
+void ReleaseSharedTexture(const std::vector<unsigned char>& pixels)
+{
+    auto found = sharedTextures.find(&pixels);
+    if (found == sharedTextures.end())
+    {
+        return;
+    }
+    if (--found->second.references == 0)
+    {
+        glDeleteTextures(1, &found->second.texture);
+        sharedTextures.erase(found);
+    }
+}
+
+// The pixels behind img.texture: the preview level of tiled images, all of them otherwise
+const std::vector<unsigned char>& ImageTexturePixels(const Image& img)
+{
+    return img.tiled ? ImageLevelPixels(img, img.previewLevel) : ImagePixels(img);
+}
+
+void ReleaseImageTexture(Image& img)
+{
+    if (img.texture != 0)
+    {
+        ReleaseSharedTexture(ImageTexturePixels(img));
+        img.texture = 0;
+    }
+}
+
+void CreateImageTextures(Image& img)
+{
+    // Tiles can outlive an evicted preview; they are re-streamed as needed
+    for (const auto& tile : img.tiles)
+    {
+        glDeleteTextures(1, &tile.texture);
+        glDeleteTextures(1, &tile.maskTexture);
+    }
+    img.tiles.clear();
+    glDeleteTextures(1, &img.maskTexture);
+    glDeleteTextures(1, &img.sharpTexture);
+    img.maskTexture = 0;
+    img.sharpTexture = 0; // Re-rendered on demand
+    img.sharpScale = 1.0f;
+    img.sharpPending = false;
+    img.sharpRequestScale = 0.0f;
+    if (img.tiled)
+    {
+        // Only the preview is resident up front; full-resolution tiles stream in when they are on screen
+        int previewWidth = LevelDimension(img.width, img.previewLevel);
+        int previewHeight = LevelDimension(img.height, img.previewLevel);
+        img.texture = AcquireSharedTexture(ImageTexturePixels(img), previewWidth, previewHeight);
+        if (img.mask)
+        {
+            img.maskTexture = CreateTextureFromData(MaskLevelPixels(img, img.previewLevel), previewWidth, previewHeight, GL_ALPHA);
+        }
+    }
+    else
+    {
+        img.texture = AcquireSharedTexture(ImageTexturePixels(img), img.width, img.height);
+        if (img.mask)
+        {
+            img.maskTexture = CreateTextureFromData(*img.mask, img.width, img.height, GL_ALPHA);
+        }
+    }
+}
+
+void DeleteImageTextures(Image& img)
+{
+    ReleaseImageTexture(img);
+    glDeleteTextures(1, &img.maskTexture);
+    glDeleteTextures(1, &img.sharpTexture);
+    img.maskTexture = 0;
+    img.sharpTexture = 0;
+    for (const auto& tile : img.tiles)
+    {
+        glDeleteTextures(1, &tile.texture);
+        glDeleteTextures(1, &tile.maskTexture);
+    }
+    img.tiles.clear();
+}
+
+GLuint CreateTileTexture(const std::vector<unsigned char>& levelPixels, int levelWidth, int levelHeight,
+                         int column, int row, GLenum format)
+{
+    int x = column * textureTileSize;
+    int y = row * textureTileSize;
+    int width = std::min(textureTileSize, levelWidth - x);
+    int height = std::min(textureTileSize, levelHeight - y);
+
+    GLuint texture = CreateTextureFromData(CopyPixelRegion(levelPixels, levelWidth, x, y, width, height, BytesPerPixel(format)),
+                                           width, height, format);
+    // Clamp so tiles don't sample across their neighbour's edge
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return texture;
+}
+
+// Returns the resident tile, streaming it in if this frame's upload budget allows. nullptr means not resident yet.
+const ImageTile* AcquireTile(Image& img, int level, int column, int row)
+{
+    for (auto& tile : img.tiles)
+    {
+        if (tile.level == level && tile.column == column && tile.row == row)
+        {
+            tile.lastUsedFrame = frameCounter;
+            return &tile;
+        }
+    }
+
+    if (tileUploadsThisFrame >= maxTileUploadsPerFrame)
+    {
+        return nullptr;
+    }
+    tileUploadsThisFrame++;
+
+    int levelWidth = LevelDimension(img.width, level);
+    int levelHeight = LevelDimension(img.height, level);
+    ImageTile tile;
+    tile.texture = CreateTileTexture(ImageLevelPixels(img, level), levelWidth, levelHeight, column, row, GL_RGBA);
+    tile.maskTexture = 0;
+    if (img.mask)
+    {
+        tile.maskTexture = CreateTileTexture(MaskLevelPixels(img, level), levelWidth, levelHeight, column, row, GL_ALPHA);
+    }
+    tile.level = level;
+    tile.column = column;
+    tile.row = row;
+    tile.lastUsedFrame = frameCounter;
+    img.tiles.push_back(tile);
+    return &img.tiles.back();
+}
+
+// Texture residency: image textures and tiles are kept within a byte budget. When over budget, whatever
+// has been off screen the longest is deleted; it is re-uploaded from the CPU copy when it scrolls back into view.
+int textureBudgetMB = 512;
+const size_t maxResidencyUploadBytesPerFrame = 64ull * 1024 * 1024;
+size_t residencyUploadBytesThisFrame = 0;
+size_t residentTextureBytes = 0;
+
+// Color plus eraser mask, including the mip chains
+size_t TextureBytes(int width, int height, bool hasMask)
+{
+    return (size_t)width * height * (hasMask ? 5 : 4) * 4 / 3;
+}
+
+// The size of img.texture: the preview level for tiled images
+void ImageTextureSize(const Image& img, int& width, int& height)
+{
+    width = img.tiled ? LevelDimension(img.width, img.previewLevel) : img.width;
+    height = img.tiled ? LevelDimension(img.height, img.previewLevel) : img.height;
+}
+
+// The eraser mask and sharp text textures, which belong to the image alone. Color textures may be
+// shared and are accounted once per sharedTextures entry.
+size_t ImageOwnTextureBytes(const Image& img)
+{
+    int width, height;
+    ImageTextureSize(img, width, height);
+    size_t bytes = img.maskTexture != 0 ? TextureBytes(width, height, true) - TextureBytes(width, height, false) : 0;
+    if (img.sharpTexture != 0)
+    {
+        bytes += TextureBytes(img.sharpWidth, img.sharpHeight, false);
+    }
+    return bytes;
+}
+
+// What making the image resident uploads; a color texture another image already holds costs nothing
+size_t ImageUploadBytes(const Image& img)
+{
+    int width, height;
+    ImageTextureSize(img, width, height);
+    size_t bytes = sharedTextures.count(&ImageTexturePixels(img)) ? 0 : TextureBytes(width, height, false);
+    if (img.mask)
+    {
+        bytes += TextureBytes(width, height, true) - TextureBytes(width, height, false);
+    }
+    return bytes;
+}
+
+// Drops the image's own textures and its color texture reference; returns the bytes actually freed
+size_t EvictImageTextures(Image& img)
+{
+    if (img.texture == 0)
+    {
+        return 0;
+    }
+    size_t freed = ImageOwnTextureBytes(img);
+    auto shared = sharedTextures.find(&ImageTexturePixels(img));
+    if (shared != sharedTextures.end() && shared->second.references == 1)
+    {
+        freed += shared->second.bytes;
+    }
+    ReleaseImageTexture(img);
+    glDeleteTextures(1, &img.maskTexture);
+    glDeleteTextures(1, &img.sharpTexture);
+    img.maskTexture = 0;
+    img.sharpTexture = 0;
+    return freed;
+}
+
+bool HoldsTextures(const Image& img)
+{
+    return img.texture != 0 || !img.tiles.empty();
+}
+
+void ForgetHistoryTextureHolder(const Image& img)
+{
+    auto holder = std::find(historyTextureHolders.begin(), historyTextureHolders.end(), &img);
+    if (holder != historyTextureHolders.end())
+    {
+        *holder = historyTextureHolders.back();
+        historyTextureHolders.pop_back();
+    }
+}
+
+size_t TileBytes(const Image& img, const ImageTile& tile)
+{
+    int levelWidth = LevelDimension(img.width, tile.level);
+    int levelHeight = LevelDimension(img.height, tile.level);
+    return TextureBytes(std::min(textureTileSize, levelWidth - tile.column * textureTileSize),
+                        std::min(textureTileSize, levelHeight - tile.row * textureTileSize), tile.maskTexture != 0);
+}
+
+// Called for images that are on screen this frame
+void EnsureImageResident(Image& img)
+{
+    img.lastVisibleFrame = frameCounter;
+    if (img.texture != 0 || img.loading)
+    {
+        return;
+    }
+
+    // Spread re-uploads over several frames when a lot scrolls into view at once
+    size_t bytes = ImageUploadBytes(img);
+    if (residencyUploadBytesThisFrame > 0 && residencyUploadBytesThisFrame + bytes > maxResidencyUploadBytesPerFrame)
+    {
+        return;
+    }
+    residencyUploadBytesThisFrame += bytes;
+    CreateImageTextures(img);
+}
+
+void EnforceTextureBudget(std::list<Image>& images)
+{
+    struct EvictionCandidate {
+        int lastUsedFrame;
+        std::vector<Image*> images;  // For a shared color texture, every image holding it
+        ImageTile* tile;             // nullptr unless the candidate is a tile of images[0]
+        size_t bytes;                // Tiles only; image evictions report what they free
+    };
+
+    // Images that undo or redo can bring back hold on to their textures too
+    auto forEachImage = [&](auto visit)
+    {
+        for (auto& img : images)
+        {
+            visit(img);
+        }
+        for (Image* img : historyTextureHolders)
+        {
+            visit(*img);
+        }
+    };
+
+    // A shared color texture is one candidate, last used when the most recently visible of its
+    // images was; it can only go once none of them is on screen
+    std::vector<EvictionCandidate> candidates;
+    std::unordered_map<const std::vector<unsigned char>*, size_t> sharedCandidates;
+    residentTextureBytes = 0;
+    forEachImage([&](Image& img)
+    {
+        if (img.texture != 0)
+        {
+            const std::vector<unsigned char>* pixels = &ImageTexturePixels(img);
+            auto inserted = sharedCandidates.emplace(pixels, candidates.size());
+            if (inserted.second)
+            {
+                candidates.push_back({img.lastVisibleFrame, {&img}, nullptr, 0});
+                auto shared = sharedTextures.find(pixels);
+                residentTextureBytes += shared != sharedTextures.end() ? shared->second.bytes : 0;
+            }
+            else
+            {
+                EvictionCandidate& candidate = candidates[inserted.first->second];
+                candidate.images.push_back(&img);
+                candidate.lastUsedFrame = std::max(candidate.lastUsedFrame, img.lastVisibleFrame);
+            }
+
+            size_t ownBytes = ImageOwnTextureBytes(img);
+            residentTextureBytes += ownBytes;
+            if (ownBytes > 0 && img.lastVisibleFrame < frameCounter)
+            {
+                candidates.push_back({img.lastVisibleFrame, {&img}, nullptr, 0});
+            }
+        }
+        for (auto& tile : img.tiles)
+        {
+            size_t bytes = TileBytes(img, tile);
+            residentTextureBytes += bytes;
+            if (tile.lastUsedFrame < frameCounter)
+            {
+                candidates.push_back({tile.lastUsedFrame, {&img}, &tile, bytes});
+            }
+        }
+    });
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+        [](const EvictionCandidate& candidate) { return candidate.lastUsedFrame >= frameCounter; }), candidates.end());
+
+    size_t budgetBytes = (size_t)textureBudgetMB * 1024 * 1024;
+    if (residentTextureBytes <= budgetBytes)
+    {
+        return;
+    }
+
+    // Least recently visible first
+    std::sort(candidates.begin(), candidates.end(), [](const EvictionCandidate& a, const EvictionCandidate& b) {
+        return a.lastUsedFrame < b.lastUsedFrame;
+    });
+
+    for (const auto& candidate : candidates)
+    {
+        if (residentTextureBytes <= budgetBytes)
+        {
+            break;
+        }
+        if (candidate.tile)
+        {
+            glDeleteTextures(1, &candidate.tile->texture);
+            glDeleteTextures(1, &candidate.tile->maskTexture);
+            candidate.tile->texture = 0;
+            candidate.tile->maskTexture = 0;
+            residentTextureBytes -= candidate.bytes;
+            continue;
+        }
+        for (Image* img : candidate.images)
+        {
+            residentTextureBytes -= EvictImageTextures(*img);
+        }
+    }
+
+    forEachImage([](Image& img)
+    {
+        img.tiles.erase(std::remove_if(img.tiles.begin(), img.tiles.end(),
+            [](const ImageTile& tile) { return tile.texture == 0; }), img.tiles.end());
+    });
+    historyTextureHolders.erase(std::remove_if(historyTextureHolders.begin(), historyTextureHolders.end(),
+        [](const Image* img) { return !HoldsTextures(*img); }), historyTextureHolders.end());
+}
+
+// Uploads [x0,x1)x[y0,y1) of a mask level into its texture, creating the texture on the first erase
+void RefreshMaskTexture(GLuint& maskTexture, const std::vector<unsigned char>& mask, int levelWidth, int levelHeight,
+                        int originX, int originY, int texWidth, int texHeight, const ImVec4& rect)
+{
+    if (maskTexture == 0)
+    {
+        maskTexture = CreateTileTexture(mask, levelWidth, levelHeight, originX / textureTileSize, originY / textureTileSize, GL_ALPHA);
+        return;
+    }
+    UpdateTextureRegion(maskTexture, mask, levelWidth, originX, originY, texWidth, texHeight,
+                        (int)rect.x, (int)rect.y, (int)rect.z, (int)rect.w, GL_ALPHA);
+}
+
+// Pushes a change to [x0,x1)x[y0,y1) of the eraser mask out to the GPU copy
+void RefreshMaskRegion(Image& img, int x0, int y0, int x1, int y1)
+{
+    if (!img.tiled)
+    {
+        // An evicted texture picks up the change when it is re-uploaded
+        if (img.texture == 0)
+        {
+            return;
+        }
+        if (img.maskTexture == 0)
+        {
+            img.maskTexture = CreateTextureFromData(*img.mask, img.width, img.height, GL_ALPHA);
+        }
+        else
+        {
+            UpdateTextureRegion(img.maskTexture, *img.mask, img.width, 0, 0, img.width, img.height, x0, y0, x1, y1, GL_ALPHA);
+        }
+        return;
+    }
+
+    // Propagate the change down the mask pyramid, then into the preview and any resident tiles
+    MakeMasksUnique(img);
+    std::vector<ImVec4> levelRects(img.previewLevel + 1);
+    levelRects[0] = ImVec4((float)x0, (float)y0, (float)x1, (float)y1);
+    for (int level = 1; level <= img.previewLevel; ++level)
+    {
+        int levelWidth = LevelDimension(img.width, level);
+        int levelHeight = LevelDimension(img.height, level);
+        x0 = std::min(x0 / 2, levelWidth);
+        y0 = std::min(y0 / 2, levelHeight);
+        x1 = std::min((x1 + 1) / 2, levelWidth);
+        y1 = std::min((y1 + 1) / 2, levelHeight);
+        DownsampleMaskRegion(MaskLevelPixels(img, level - 1), LevelDimension(img.width, level - 1), LevelDimension(img.height, level - 1),
+                             *img.maskPyramid[level - 1], levelWidth, x0, y0, x1, y1);
+        levelRects[level] = ImVec4((float)x0, (float)y0, (float)x1, (float)y1);
+    }
+
+    if (img.texture != 0)
+    {
+        int previewWidth = LevelDimension(img.width, img.previewLevel);
+        int previewHeight = LevelDimension(img.height, img.previewLevel);
+        RefreshMaskTexture(img.maskTexture, MaskLevelPixels(img, img.previewLevel), previewWidth, previewHeight,
+                           0, 0, previewWidth, previewHeight, levelRects[img.previewLevel]);
+    }
+
+    for (auto& tile : img.tiles)
+    {
+        int levelWidth = LevelDimension(img.width, tile.level);
+        int levelHeight = LevelDimension(img.height, tile.level);
+        int originX = tile.column * textureTileSize;
+        int originY = tile.row * textureTileSize;
+        RefreshMaskTexture(tile.maskTexture, MaskLevelPixels(img, tile.level), levelWidth, levelHeight,
+                           originX, originY, std::min(textureTileSize, levelWidth - originX), std::min(textureTileSize, levelHeight - originY),
+                           levelRects[tile.level]);
+    }
+}
+
+// Grows the image's pending upload rectangle; all edits in a frame go up in one upload
+void MarkImageDirty(Image& img, int x0, int y0, int x1, int y1)
+{
+    if (!img.hasDirtyRect)
+    {
+        img.hasDirtyRect = true;
+        img.dirtyMinX = x0;
+        img.dirtyMinY = y0;
+        img.dirtyMaxX = x1;
+        img.dirtyMaxY = y1;
+        return;
+    }
+    img.dirtyMinX = std::min(img.dirtyMinX, x0);
+    img.dirtyMinY = std::min(img.dirtyMinY, y0);
+    img.dirtyMaxX = std::max(img.dirtyMaxX, x1);
+    img.dirtyMaxY = std::max(img.dirtyMaxY, y1);
+}
+
+void FlushImageUploads(std::list<Image>& images)
+{
+    for (auto& img : images)
+    {
+        if (img.hasDirtyRect)
+        {
+            RefreshMaskRegion(img, img.dirtyMinX, img.dirtyMinY, img.dirtyMaxX, img.dirtyMaxY);
+            img.hasDirtyRect = false;
+        }
+    }
+}
+
+// Shader used to composite the eraser mask with the color texture. It is linked against the attribute
+// locations of the ImGui backend's own program, so it can be swapped in from a draw callback.
+const char* maskedImageVertexShader = R"(
+#version 120
+uniform mat4 ProjMtx;
+attribute vec2 Position;
+attribute vec2 UV;
+attribute vec4 Color;
+varying vec2 Frag_UV;
+varying vec4 Frag_Color;
+void main()
+{
+    Frag_UV = UV;
+    Frag_Color = Color;
+    gl_Position = ProjMtx * vec4(Position.xy, 0, 1);
+}
+)";
+
+const char* maskedImageFragmentShader = R"(
+#version 120
+uniform sampler2D Texture;
+uniform sampler2D MaskTexture;
+varying vec2 Frag_UV;
+varying vec4 Frag_Color;
+void main()
+{
+    vec4 color = Frag_Color * texture2D(Texture, Frag_UV.st);
+    color.a *= texture2D(MaskTexture, Frag_UV.st).a;
+    gl_FragColor = color;
+}
+)";
+
+GLuint CompileShader(GLenum type, const char* source)
+{
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint status = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status)
+    {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cerr << "Failed to compile shader: " << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Must be called while the backend's program is bound (i.e. from a draw callback)
+GLuint CreateCanvasShaderProgram(const char* vertexSource, const char* fragmentSource)
+{
+    GLint backendProgram = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &backendProgram);
+
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (!vertexShader || !fragmentShader)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    for (const char* attribute : { "Position", "UV", "Color" })
+    {
+        GLint location = glGetAttribLocation(backendProgram, attribute);
+        if (location >= 0)
+        {
+            glBindAttribLocation(program, location, attribute);
+        }
+    }
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status)
+    {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cerr << "Failed to link shader program: " << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Same orthographic projection the ImGui backend uses
+void SetCanvasProjection(GLuint program)
+{
+    ImDrawData* drawData = ImGui::GetDrawData();
+    float L = drawData->DisplayPos.x;
+    float R = drawData->DisplayPos.x + drawData->DisplaySize.x;
+    float T = drawData->DisplayPos.y;
+    float B = drawData->DisplayPos.y + drawData->DisplaySize.y;
+    const float ortho[4][4] = {
+        { 2.0f / (R - L), 0.0f, 0.0f, 0.0f },
+        { 0.0f, 2.0f / (T - B), 0.0f, 0.0f },
+        { 0.0f, 0.0f, -1.0f, 0.0f },
+        { (R + L) / (L - R), (T + B) / (B - T), 0.0f, 1.0f },
+    };
+    glUniformMatrix4fv(glGetUniformLocation(program, "ProjMtx"), 1, GL_FALSE, &ortho[0][0]);
+}
+
+GLuint maskedImageProgram = 0;
+bool maskedImageProgramFailed = false;
+
+void BeginMaskedImageCallback(const ImDrawList*, const ImDrawCmd* cmd)
+{
+    if (!maskedImageProgram && !maskedImageProgramFailed)
+    {
+        maskedImageProgram = CreateCanvasShaderProgram(maskedImageVertexShader, maskedImageFragmentShader);
+        maskedImageProgramFailed = maskedImageProgram == 0;
+    }
+    if (!maskedImageProgram)
+    {
+        return;
+    }
+
+    glUseProgram(maskedImageProgram);
+    SetCanvasProjection(maskedImageProgram);
+    glUniform1i(glGetUniformLocation(maskedImageProgram, "Texture"), 0);
+    glUniform1i(glGetUniformLocation(maskedImageProgram, "MaskTexture"), 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)cmd->UserCallbackData);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// Draws a textured quad, multiplying in the eraser mask when there is one
+void DrawMaskedImageQuad(ImDrawList* draw_list, GLuint texture, GLuint maskTexture, const ImVec2 quad[4],
+                         ImVec2 uv0 = ImVec2(0, 0), ImVec2 uv1 = ImVec2(1, 0), ImVec2 uv2 = ImVec2(1, 1), ImVec2 uv3 = ImVec2(0, 1))
+{
+    if (maskTexture != 0)
+    {
+        draw_list->AddCallback(BeginMaskedImageCallback, (void*)(intptr_t)maskTexture);
+    }
+    draw_list->AddImageQuad((void*)(intptr_t)texture, quad[0], quad[1], quad[2], quad[3], uv0, uv1, uv2, uv3);
+    if (maskTexture != 0)
+    {
+        draw_list->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+    }
+}
+
+const char* sdfTextFragmentShader = R"(
+#version 120
+uniform sampler2D Texture;
+uniform vec4 StrokeColor;
+uniform float StrokeWidth;
+varying vec2 Frag_UV;
+varying vec4 Frag_Color;
+void main()
+{
+    float distance = texture2D(Texture, Frag_UV.st).a;
+    float smoothing = max(fwidth(distance) * 0.5, 0.001);
+    float fillAlpha = Frag_Color.a * smoothstep(0.5 - smoothing, 0.5 + smoothing, distance);
+    float strokeEdge = 0.5 - StrokeWidth;
+    float strokeAlpha = StrokeColor.a * smoothstep(strokeEdge - smoothing, strokeEdge + smoothing, distance);
+    if (StrokeWidth <= 0.0)
+        strokeAlpha = 0.0;
+
+    // Fill over stroke, in straight alpha like the CPU text renderer
+    float strokeWeight = strokeAlpha * (1.0 - fillAlpha);
+    float alpha = fillAlpha + strokeWeight;
+    vec3 color = (Frag_Color.rgb * fillAlpha + StrokeColor.rgb * strokeWeight) / max(alpha, 0.0001);
+    gl_FragColor = vec4(color, alpha);
+}
+)";
+
+struct SdfTextParams
+{
+    ImVec4 strokeColor;
+    float strokeWidth; // In distance field units
+};
+
+// Parameters for this frame's distance field draws; a deque so callback pointers stay valid
+std::deque<SdfTextParams> sdfTextParams;
+GLuint sdfTextProgram = 0;
+bool sdfTextProgramFailed = false;
+
+void BeginSdfTextCallback(const ImDrawList*, const ImDrawCmd* cmd)
+{
+    if (!sdfTextProgram && !sdfTextProgramFailed)
+    {
+        sdfTextProgram = CreateCanvasShaderProgram(maskedImageVertexShader, sdfTextFragmentShader);
+        sdfTextProgramFailed = sdfTextProgram == 0;
+    }
+    if (!sdfTextProgram)
+    {
+        return;
+    }
+
+    const SdfTextParams* params = (const SdfTextParams*)cmd->UserCallbackData;
+    glUseProgram(sdfTextProgram);
+    SetCanvasProjection(sdfTextProgram);
+    glUniform1i(glGetUniformLocation(sdfTextProgram, "Texture"), 0);
+    glUniform4f(glGetUniformLocation(sdfTextProgram, "StrokeColor"),
+                params->strokeColor.x, params->strokeColor.y, params->strokeColor.z, params->strokeColor.w);
+    glUniform1f(glGetUniformLocation(sdfTextProgram, "StrokeWidth"), params->strokeWidth);
+}
+
+// Dots generated per pixel from the screen position, which DrawGrid passes in as the UV
+const char* gridFragmentShader = R"(
+#version 120
+uniform vec2 GridOrigin;
+uniform float Spacing;
+uniform float DotRadius;
+uniform vec4 DotColor;
+varying vec2 Frag_UV;
+varying vec4 Frag_Color;
+void main()
+{
+    vec2 cell = mod(Frag_UV - GridOrigin + 0.5 * Spacing, Spacing) - 0.5 * Spacing;
+    float coverage = clamp(DotRadius + 0.5 - length(cell), 0.0, 1.0);
+    gl_FragColor = mix(Frag_Color, vec4(DotColor.rgb, 1.0), coverage * DotColor.a);
+}
+)";
+
+struct GridParams
+{
+    ImVec2 origin;  // Screen position of one of the dots
+    float spacing;
+    float dotRadius;
+    ImVec4 dotColor;
+};
+
+GridParams gridParams;
+GLuint gridProgram = 0;
+bool gridProgramFailed = false;
+
+void BeginGridCallback(const ImDrawList*, const ImDrawCmd*)
+{
+    if (!gridProgram && !gridProgramFailed)
+    {
+        gridProgram = CreateCanvasShaderProgram(maskedImageVertexShader, gridFragmentShader);
+        gridProgramFailed = gridProgram == 0;
+    }
+    if (!gridProgram)
+    {
+        return;
+    }
+
+    glUseProgram(gridProgram);
+    SetCanvasProjection(gridProgram);
+    glUniform2f(glGetUniformLocation(gridProgram, "GridOrigin"), gridParams.origin.x, gridParams.origin.y);
+    glUniform1f(glGetUniformLocation(gridProgram, "Spacing"), gridParams.spacing);
+    glUniform1f(glGetUniformLocation(gridProgram, "DotRadius"), gridParams.dotRadius);
+    glUniform4f(glGetUniformLocation(gridProgram, "DotColor"),
+                gridParams.dotColor.x, gridParams.dotColor.y, gridParams.dotColor.z, gridParams.dotColor.w);
+}
+
+// Draws the background and its dot grid as a single quad shaded on the GPU
+void DrawGrid(ImDrawList* draw_list, const ImVec2& windowPos, const ImVec2& windowSize)
+{
+    const ImU32 backgroundColor = IM_COL32(18, 18, 28, 255);
+    const float baseSpacing = 36.0f; // Base spacing between dots
+    const float baseSize = 1.0f; // Base size of dots
+    const ImU32 dotColor = IM_COL32(179, 179, 204, 255);
+
+    float spacing = baseSpacing * gridScale;
+    float size = baseSize * gridScale;
+
+    // Thin the grid out when zoomed far out
+    const float minSpacing = 10.0f; // Minimum spacing between dots
+
+    if (spacing < minSpacing)
+    {
+        int factor = static_cast<int>(minSpacing / spacing) + 1;
+        spacing *= factor;
+        size *= std::sqrt(factor); // Increase dot size when spacing increases
+    }
+
+    // Ensure a minimum visible size for dots
+    const float minVisibleSize = 0.5f;
+    size = std::max(size, minVisibleSize);
+
+    ImVec2 windowMax(windowPos.x + windowSize.x, windowPos.y + windowSize.y);
+    if (gridProgramFailed)
+    {
+        // Without the shader only the background is drawn
+        draw_list->AddRectFilled(windowPos, windowMax, backgroundColor);
+        return;
+    }
+
+    gridParams.origin = ImVec2(windowPos.x + gridOffset.x, windowPos.y + gridOffset.y);
+    gridParams.spacing = spacing;
+    gridParams.dotRadius = size / 2;
+    gridParams.dotColor = ImGui::ColorConvertU32ToFloat4(dotColor);
+
+    draw_list->AddCallback(BeginGridCallback, nullptr);
+    draw_list->PrimReserve(6, 4);
+    draw_list->PrimRectUV(windowPos, windowMax, windowPos, windowMax, backgroundColor);
+    draw_list->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+}
+
+// The field only reaches sdfSpread texels past the glyph edge, so wider outlines can't come from it;
+// those texts are drawn from their rasterized cache instead
+bool CanDrawSdfText(float fontSize, float strokeWidth)
+{
+    float strokeTexels = strokeWidth * sdfFontSize / fontSize;
+    return sdfTextEnabled && !sdfTextProgramFailed && strokeTexels <= sdfSpread;
+}
+
+// Draws text from the distance field atlas; stays sharp at any size, with the outline done in the
+// shader. The outline must fit in the field (CanDrawSdfText).
+void DrawSdfText(ImDrawList* draw_list, int fontIndex, float fontSize, ImVec2 pos, ImVec4 fillColor,
+                 ImVec4 strokeColor, float strokeWidth, const char* text)
+{
+    float strokeTexels = strokeWidth * sdfFontSize / fontSize;
+    sdfTextParams.push_back({ strokeColor, std::min(strokeTexels, (float)sdfSpread) / (2.0f * sdfSpread) });
+
+    std::lock_guard<std::mutex> lock(glyphMutex);
+    std::vector<PlacedGlyph> placed;
+    LayoutText(fontIndex, fontSize, pos, text, placed);
+    if (placed.empty())
+    {
+        return;
+    }
+
+    draw_list->AddCallback(BeginSdfTextCallback, &sdfTextParams.back());
+    ImU32 color = ImGui::ColorConvertFloat4ToU32(fillColor);
+    int currentPage = -1;
+    for (const auto& item : placed)
+    {
+        const Glyph& glyph = *item.glyph;
+        if (glyph.page != currentPage)
+        {
+            if (currentPage >= 0)
+            {
+                draw_list->PopTextureID();
+            }
+            EnsureGlyphPageTexture(glyphPages[glyph.page]);
+            draw_list->PushTextureID((void*)(intptr_t)glyphPages[glyph.page].texture);
+            currentPage = glyph.page;
+        }
+        ImVec2 uvMin((float)glyph.x / glyphPageSize, (float)glyph.y / glyphPageSize);
+        ImVec2 uvMax((float)(glyph.x + glyph.width) / glyphPageSize, (float)(glyph.y + glyph.height) / glyphPageSize);
+        draw_list->PrimReserve(6, 4);
+        draw_list->PrimRectUV(item.min, item.max, uvMin, uvMax, color);
+    }
+    draw_list->PopTextureID();
+    draw_list->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+}
+
+// Worker threads for work that must stay off the UI/GL thread (image decoding)
+struct WorkerPool {
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    bool stopping = false;
+};
+
+WorkerPool workerPool;
+
+// Caps the decoded bytes held by workers at once, so a large batch import keeps peak memory bounded
+const size_t maxDecodeBytesInFlight = 512ull * 1024 * 1024;
+std::mutex decodeBudgetMutex;
+std::condition_variable decodeBudgetReleased;
+size_t decodeBytesInFlight = 0;
+bool decodeCancelled = false;  // Set on shutdown; nothing releases budget once the main loop has ended
+
+void WorkerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(workerPool.mutex);
+            workerPool.taskAvailable.wait(lock, [] { return workerPool.stopping || !workerPool.tasks.empty(); });
+            if (workerPool.stopping)
+            {
+                return;
+            }
+            task = std::move(workerPool.tasks.front());
+            workerPool.tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void StartWorkerPool()
+{
+    // Leave one core for the UI thread
+    unsigned int cores = std::thread::hardware_concurrency();
+    unsigned int threadCount = cores > 1 ? cores - 1 : 1;
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        workerPool.threads.emplace_back(WorkerLoop);
+    }
+    std::cout << "Started " << threadCount << " worker threads" << std::endl;
+}
+
+void StopWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(workerPool.mutex);
+        workerPool.stopping = true;
+        workerPool.tasks.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(decodeBudgetMutex);
+        decodeCancelled = true;
+    }
+    workerPool.taskAvailable.notify_all();
+    decodeBudgetReleased.notify_all();
+    for (auto& thread : workerPool.threads)
+    {
+        thread.join();
+    }
+    workerPool.threads.clear();
+}
+
+void SubmitTask(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(workerPool.mutex);
+        workerPool.tasks.push_back(std::move(task));
+    }
+    workerPool.taskAvailable.notify_one();
+}
+
+// Pixels decoded by a worker, waiting for the GL thread to upload them
+struct DecodedImage {
+    int imageId;
+    int width;   // 0 if decoding failed
+    int height;
+    PixelBuffer data;
+    std::vector<PixelBuffer> pyramid;  // Only for images that will be tiled
+    std::shared_ptr<std::vector<HitMaskLevel>> hitMask;
+    size_t reservedBytes;  // Share of the decode budget, released once uploaded
+};
+
+std::mutex decodedImagesMutex;
+std::vector<DecodedImage> decodedImages;
+
+// Progress of the current import, shown as an overlay until every queued image is decoded
+int importTotal = 0;
+int importCompleted = 0;
+
+// Returns false if the app is shutting down, in which case the caller must not decode
+bool AcquireDecodeBudget(size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(decodeBudgetMutex);
+    // A single image larger than the whole budget is still allowed through on its own
+    decodeBudgetReleased.wait(lock, [bytes] {
+        return decodeCancelled || decodeBytesInFlight == 0 || decodeBytesInFlight + bytes <= maxDecodeBytesInFlight;
+    });
+    if (decodeCancelled)
+    {
+        return false;
+    }
+    decodeBytesInFlight += bytes;
+    return true;
+}
+
+void ReleaseDecodeBudget(size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(decodeBudgetMutex);
+        decodeBytesInFlight -= bytes;
+    }
+    decodeBudgetReleased.notify_all();
+}
+
+// Reads only the file header so a placeholder with the right aspect ratio can be shown immediately
+bool ReadImageInfo(const char* filename, Image& img)
+{
+    int channels;
+    if (!stbi_info(filename, &img.width, &img.height, &channels))
+    {
+        std::cerr << "Failed to read image header: " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void QueueImageDecode(int imageId, const std::string& filename, size_t estimatedBytes)
+{
+    importTotal++;
+    SubmitTask([imageId, filename, estimatedBytes]() {
+        if (!AcquireDecodeBudget(estimatedBytes))
+        {
+            return;
+        }
+
+        DecodedImage decoded;
+        decoded.imageId = imageId;
+        decoded.width = 0;
+        decoded.height = 0;
+        decoded.reservedBytes = estimatedBytes;
+
+        int channels;
+        unsigned char* pixels = stbi_load(filename.c_str(), &decoded.width, &decoded.height, &channels, 4);
+        if (pixels == nullptr)
+        {
+            std::cerr << "Failed to load image " << filename << ": " << stbi_failure_reason() << std::endl;
+            decoded.width = decoded.height = 0;
+        }
+        else
+        {
+            auto data = std::make_shared<std::vector<unsigned char>>(pixels, pixels + (size_t)decoded.width * decoded.height * 4);
+            stbi_image_free(pixels);
+            decoded.hitMask = std::make_shared<std::vector<HitMaskLevel>>(BuildHitMask(*data, decoded.width, decoded.height));
+
+            if (NeedsTiling(decoded.width, decoded.height))
+            {
+                for (auto& level : BuildImagePyramid(*data, decoded.width, decoded.height))
+                {
+                    decoded.pyramid.push_back(std::make_shared<std::vector<unsigned char>>(std::move(level)));
+                }
+            }
+            decoded.data = std::move(data);
+        }
+
+        std::lock_guard<std::mutex> lock(decodedImagesMutex);
+        decodedImages.push_back(std::move(decoded));
+    });
+}
+
+void ApplyDecodedImage(Image& img, const DecodedImage& decoded)
+{
+    img.loading = false;
+    if (decoded.width == 0)
+    {
+        // Drop the placeholder, it is removed with the other closed images
+        img.open = false;
+        return;
+    }
+    img.width = decoded.width;
+    img.height = decoded.height;
+    img.data = decoded.data;
+    img.pyramid = decoded.pyramid;
+    img.hitMask = decoded.hitMask;
+    img.tiled = !img.pyramid.empty();
+    img.previewLevel = (int)img.pyramid.size();
+}
+
+// Called on the GL thread once per frame: swaps finished decodes into their placeholders
+void ProcessDecodedImages()
+{
+    std::vector<DecodedImage> finished;
+    {
+        std::lock_guard<std::mutex> lock(decodedImagesMutex);
+        finished.swap(decodedImages);
+    }
+
+    for (const auto& decoded : finished)
+    {
+        ReleaseDecodeBudget(decoded.reservedBytes);
+        importCompleted++;
+
+        // The history may hold the placeholder too, if its insert was undone; fill it so redoing
+        // doesn't bring back a stale one
+        for (auto* history : { &undoHistory, &redoHistory })
+        {
+            for (auto& command : *history)
+            {
+                for (auto& entry : command.removed)
+                {
+                    if (entry.image.id == decoded.imageId && entry.image.loading)
+                    {
+                        ApplyDecodedImage(entry.image, decoded);
+                    }
+                }
+            }
+        }
+
+        for (auto& img : images)
+        {
+            if (img.id == decoded.imageId && img.loading)
+            {
+                ApplyDecodedImage(img, decoded);
+                if (img.open)
+                {
+                    CreateImageTextures(img);
+                    std::cout << "Image loaded successfully. Width: " << img.width << ", Height: " << img.height << std::endl;
+                }
+            }
+        }
+    }
+
+    if (importCompleted >= importTotal)
+    {
+        importTotal = importCompleted = 0;
+    }
+}
+
+// A text image re-rendered by a worker at a larger scale, waiting to be uploaded
+struct TextRaster {
+    int imageId;
+    float scale;
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+std::mutex textRastersMutex;
+std::vector<TextRaster> finishedTextRasters;
+const int maxTextRasterSize = 4096;
+
+// Queues a sharper rendering of a visible text image when it is shown noticeably larger than it was
+// rendered. The current texture keeps being drawn until the new one arrives.
+void RequestSharpTextRaster(Image& img)
+{
+    if (img.sharpPending || img.textFontIndex < 0 || img.texture == 0)
+    {
+        return;
+    }
+
+    // Limit the texture size both to the driver's limit and to something reasonable to keep around
+    float framebufferScale = ImGui::GetIO().DisplayFramebufferScale.x;
+    float limit = (float)std::min(maxTextRasterSize, maxTextureSize);
+    float maxScale = std::min(limit / img.width, limit / img.height);
+    float desiredScale = std::min(ImageScreenScale(img) * framebufferScale, maxScale);
+    if (desiredScale <= 1.0f)
+    {
+        // The base texture and its mipmaps are enough
+        if (img.sharpTexture != 0)
+        {
+            glDeleteTextures(1, &img.sharpTexture);
+            img.sharpTexture = 0;
+            img.sharpScale = 1.0f;
+        }
+        return;
+    }
+
+    // Re-render only once the zoom has moved by about a fifth from what the texture was made for
+    if (img.sharpTexture != 0 && std::abs(std::log2(desiredScale / img.sharpScale)) < 0.25f)
+    {
+        img.sharpRequestScale = 0.0f;
+        return;
+    }
+
+    // ...and has then held still for a moment, so a zoom gesture doesn't queue a render per step
+    double now = ImGui::GetTime();
+    if (img.sharpRequestScale <= 0.0f || std::abs(std::log2(desiredScale / img.sharpRequestScale)) > 0.05f)
+    {
+        img.sharpRequestScale = desiredScale;
+        img.sharpRequestTime = now;
+        return;
+    }
+    if (now - img.sharpRequestTime < 0.15)
+    {
+        return;
+    }
+    img.sharpRequestScale = 0.0f;
+
+    img.sharpPending = true;
+    int imageId = img.id;
+    std::string content = img.textContent;
+    int fontIndex = img.textFontIndex;
+    float fontSize = img.textFontSize;
+    ImVec4 fillColor = img.textFillColor;
+    ImVec4 strokeColor = img.textStrokeColor;
+    float strokeWidth = img.textStrokeWidth;
+    SubmitTask([=]() {
+        TextRaster raster;
+        raster.imageId = imageId;
+        raster.scale = desiredScale;
+        raster.pixels = RenderTextToPixels(content.c_str(), fontIndex, fontSize * desiredScale, fillColor, strokeColor,
+                                           strokeWidth * desiredScale, raster.width, raster.height, 5.0f * desiredScale);
+        std::lock_guard<std::mutex> lock(textRastersMutex);
+        finishedTextRasters.push_back(std::move(raster));
+    });
+}
+
+// Swaps finished renderings in on the main thread, between frames, and frees the textures they replace
+void ProcessTextRasters()
+{
+    std::vector<TextRaster> finished;
+    {
+        std::lock_guard<std::mutex> lock(textRastersMutex);
+        finished.swap(finishedTextRasters);
+    }
+
+    for (const auto& raster : finished)
+    {
+        auto img = std::find_if(images.begin(), images.end(), [&](const Image& i) { return i.id == raster.imageId; });
+        if (img == images.end())
+        {
+            continue;
+        }
+        img->sharpPending = false;
+        if (img->texture == 0)
+        {
+            // Evicted while the worker was busy
+            continue;
+        }
+        glDeleteTextures(1, &img->sharpTexture);
+        img->sharpTexture = CreateTextureFromData(raster.pixels, raster.width, raster.height);
+        img->sharpWidth = raster.width;
+        img->sharpHeight = raster.height;
+        img->sharpScale = raster.scale;
+    }
+}
+
+// Adds a placeholder for the file and queues its decode. Images land in the order they are added,
+// regardless of which decode finishes first, because the upload order is assigned here.
+bool AddImageFromFile(const std::string& filename, ImVec2 position, float maxDisplaySize)
+{
+    Image img;
+    if (!ReadImageInfo(filename.c_str(), img))
+    {
+        return false;
+    }
+
+    img.id = nextImageId++;
+    img.texture = 0;
+    img.loading = true;
+    img.tiled = false;
+    img.previewLevel = 0;
+    img.isTextImage = false;
+    img.maskTexture = 0;
+    img.lastVisibleFrame = frameCounter;
+    img.hasDirtyRect = false;
+    img.textFontIndex = -1;
+    img.sharpTexture = 0;
+    img.sharpScale = 1.0f;
+    img.sharpPending = false;
+    img.sharpRequestScale = 0.0f;
+    img.originalWidth = img.width;
+    img.originalHeight = img.height;
+    // position and maxDisplaySize are in screen units; the image is stored in world units
+    img.zoom = 1.0f;
+    if (maxDisplaySize > 0.0f)
+    {
+        img.zoom = std::min(1.0f, maxDisplaySize / std::max(img.width, img.height));
+    }
+    img.zoom /= gridScale;
+    img.position = img.targetPosition = ScreenToWorld(position);
+    img.name = filename;
+    img.open = true;
+    img.selected = false;
+    img.mirrored = false;
+    img.uploadOrder = nextUploadOrder++;
+    img.eraserMode = false;
+    img.eraserSize = 5;
+    img.rotation = 0.0f;
+    img.targetRotation = 0.0f;
+    img.isHoveringZoomControl = false;
+    img.activeZoomCorner = -1;
+    img.spatial.depth = -1;
+    images.push_back(img);
+    UpdateImageSpatialIndex(images.back());
+
+    QueueImageDecode(img.id, filename, (size_t)img.width * img.height * 4);
+    return true;
+}
+
+ImageTransform GetImageTransform(const Image& img)
+{
+    return { img.targetPosition, img.zoom, img.rotation, img.mirrored };
+}
+
+void SetImageTransform(Image& img, const ImageTransform& transform)
+{
+    img.position = img.targetPosition = transform.position;
+    img.zoom = transform.zoom;
+    img.rotation = img.targetRotation = transform.rotation;
+    img.mirrored = transform.mirrored;
+    UpdateImageSpatialIndex(img);
+}
+
+std::list<Image>::iterator FindImage(int id)
+{
+    return std::find_if(images.begin(), images.end(), [id](const Image& img) { return img.id == id; });
+}
+
+// Steps that can no longer be reached let go of the textures their removed images held
+void DiscardUndoCommands(std::vector<UndoCommand>& history)
+{
+    for (auto& command : history)
+    {
+        for (auto& entry : command.removed)
+        {
+            ForgetHistoryTextureHolder(entry.image);
+            DeleteImageTextures(entry.image);
+        }
+    }
+    history.clear();
+}
+
+void PushUndoCommand(UndoCommand command)
+{
+    undoHistory.push_back(std::move(command));
+    DiscardUndoCommands(redoHistory);
+}
+
+// Takes the images out of the list, remembering where each one was. They keep their textures, so
+// putting them back uploads nothing; the texture budget may still evict them.
+void TakeImagesOut(const std::vector<int>& ids, std::vector<RemovedImage>& removed)
+{
+    std::unordered_set<int> wanted(ids.begin(), ids.end());
+    int index = 0;
+    for (auto it = images.begin(); it != images.end(); ++index)
+    {
+        if (wanted.count(it->id) == 0)
+        {
+            ++it;
+            continue;
+        }
+
+        RemoveImageFromSpatialIndex(*it);
+        removed.push_back({ index, std::move(*it) });
+        Image& img = removed.back().image;
+        img.selected = false;
+        img.sharpPending = false; // A raster finishing now is dropped, so one is requested again once it is back
+        img.eraserMode = false;
+        it = images.erase(it);
+    }
+
+    // Only once removed has stopped growing, so the pointers stay valid
+    for (auto& entry : removed)
+    {
+        if (HoldsTextures(entry.image))
+        {
+            historyTextureHolders.push_back(&entry.image);
+        }
+    }
+}
+
+// Puts images back where TakeImagesOut found them; entries are in list order
+void PutImagesBack(std::vector<RemovedImage>& removed)
+{
+    auto position = images.begin();
+    int index = 0;
+    for (auto& entry : removed)
+    {
+        while (index < entry.index && position != images.end())
+        {
+            ++position;
+            ++index;
+        }
+        ForgetHistoryTextureHolder(entry.image);
+        Image& img = *images.insert(position, std::move(entry.image));
+        index++;
+        img.spatial.depth = -1;
+        UpdateImageSpatialIndex(img);
+    }
+    removed.clear();
+}
+
+void RecordInsert(const std::vector<int>& ids)
+{
+    UndoCommand command{};
+    command.type = UndoInsert;
+    command.imageIds = ids;
+    PushUndoCommand(std::move(command));
+}
+
+// Deletes the images as one undoable step
+void RemoveImagesWithUndo(const std::vector<int>& ids)
+{
+    if (ids.empty())
+    {
+        return;
+    }
+    UndoCommand command{};
+    command.type = UndoRemove;
+    command.imageIds = ids;
+    TakeImagesOut(ids, command.removed);
+    PushUndoCommand(std::move(command));
+}
+
+// Records the change from before to the image's current transform, if there is one
+void RecordTransform(const Image& img, const ImageTransform& before)
+{
+    ImageTransform after = GetImageTransform(img);
+    if (after.position.x == before.position.x && after.position.y == before.position.y &&
+        after.zoom == before.zoom && after.rotation == before.rotation && after.mirrored == before.mirrored)
+    {
+        return;
+    }
+    UndoCommand command{};
+    command.type = UndoTransform;
+    command.imageIds = { img.id };
+    command.before = before;
+    command.after = after;
+    PushUndoCommand(std::move(command));
+}
+
+void MaskTileRect(const Image& img, const MaskTile& tile, int& x0, int& y0, int& x1, int& y1)
+{
+    x0 = tile.column * maskUndoTileSize;
+    y0 = tile.row * maskUndoTileSize;
+    x1 = std::min(x0 + maskUndoTileSize, img.width);
+    y1 = std::min(y0 + maskUndoTileSize, img.height);
+}
+
+std::vector<unsigned char> CompressMaskTile(const Image& img, const MaskTile& tile)
+{
+    int x0, y0, x1, y1;
+    MaskTileRect(img, tile, x0, y0, x1, y1);
+    std::vector<unsigned char> runs;
+    for (int y = y0; y < y1; ++y)
+    {
+        const unsigned char* row = &(*img.mask)[(size_t)y * img.width];
+        for (int x = x0; x < x1; )
+        {
+            unsigned char value = row[x];
+            int count = 1;
+            while (x + count < x1 && count < 255 && row[x + count] == value)
+            {
+                count++;
+            }
+            runs.push_back((unsigned char)count);
+            runs.push_back(value);
+            x += count;
+        }
+    }
+    return runs;
+}
+
+void DecompressMaskTile(Image& img, const MaskTile& tile)
+{
+    int x0, y0, x1, y1;
+    MaskTileRect(img, tile, x0, y0, x1, y1);
+    int x = x0;
+    int y = y0;
+    for (size_t i = 0; i + 1 < tile.runs.size(); i += 2)
+    {
+        unsigned char* row = &(*img.mask)[(size_t)y * img.width];
+        std::fill(row + x, row + x + tile.runs[i], tile.runs[i + 1]);
+        x += tile.runs[i];
+        if (x >= x1)
+        {
+            x = x0;
+            y++;
+        }
+    }
+}
+
+// Exchanges the mask tiles with the image's current ones, then uploads just those rectangles
+void SwapMaskTiles(Image& img, std::vector<MaskTile>& tiles)
+{
+    EnsureEraserMask(img);
+    MakeMasksUnique(img);
+    for (auto& tile : tiles)
+    {
+        std::vector<unsigned char> current = CompressMaskTile(img, tile);
+        DecompressMaskTile(img, tile);
+        tile.runs.swap(current);
+
+        int x0, y0, x1, y1;
+        MaskTileRect(img, tile, x0, y0, x1, y1);
+        RefreshMaskRegion(img, x0, y0, x1, y1);
+        if (img.hitMask)
+        {
+            RefreshHitMask(*img.hitMask, ImagePixels(img), *img.mask, img.width, img.height, x0, y0, x1, y1);
+        }
+    }
+}
+
+// Moving to the back relinks the image at the front of the list, so nothing else changes place
+void SendImageToBack(std::list<Image>::iterator it)
+{
+    if (it == images.begin())
+    {
+        return;
+    }
+    UndoCommand command{};
+    command.type = UndoToBack;
+    command.imageIds = { it->id };
+    command.index = (int)std::distance(images.begin(), it);
+    command.uploadOrderBefore = it->uploadOrder;
+    command.uploadOrderAfter = images.front().uploadOrder - 1;
+    PushUndoCommand(std::move(command));
+
+    it->uploadOrder = images.front().uploadOrder - 1;
+    images.splice(images.begin(), images, it);
+}
+
+void ApplyUndoCommand(UndoCommand& command, bool undo)
+{
+    switch (command.type)
+    {
+        case UndoInsert:
+        case UndoRemove:
+            if (undo == (command.type == UndoInsert))
+            {
+                TakeImagesOut(command.imageIds, command.removed);
+            }
+            else
+            {
+                PutImagesBack(command.removed);
+            }
+            break;
+        case UndoTransform:
+        {
+            auto it = FindImage(command.imageIds[0]);
+            if (it != images.end())
+            {
+                SetImageTransform(*it, undo ? command.before : command.after);
+            }
+            break;
+        }
+        case UndoToBack:
+        {
+            auto it = FindImage(command.imageIds[0]);
+            if (it == images.end())
+            {
+                break;
+            }
+            if (undo)
+            {
+                it->uploadOrder = command.uploadOrderBefore;
+                std::list<Image> moving;
+                moving.splice(moving.begin(), images, it);
+                images.splice(std::next(images.begin(), std::min(command.index, (int)images.size())), moving);
+            }
+            else
+            {
+                it->uploadOrder = command.uploadOrderAfter;
+                images.splice(images.begin(), images, it);
+            }
+            break;
+        }
+        case UndoErase:
+        {
+            auto it = FindImage(command.imageIds[0]);
+            if (it != images.end())
+            {
+                SwapMaskTiles(*it, command.maskTiles);
+            }
+            break;
+        }
+    }
+}
+
+// Imports several files as one undoable step. A batch is laid out on a grid so it doesn't pile up in one spot.
+void ImportImageFiles(const std::vector<std::string>& files)
+{
+    if (files.empty())
+    {
+        return;
+    }
+
+    const float cellSize = 260.0f;
+    const float cellPadding = 20.0f;
+    int columns = std::max(1, (int)std::ceil(std::sqrt((float)files.size())));
+
+    int added = 0;
+    std::vector<int> addedIds;
+    for (const auto& file : files)
+    {
+        bool loaded;
+        if (files.size() == 1)
+        {
+            loaded = AddImageFromFile(file, ImVec2(50, 50), 0.0f);
+        }
+        else
+        {
+            ImVec2 cellPos(50 + (added % columns) * cellSize, 50 + (added / columns) * cellSize);
+            loaded = AddImageFromFile(file, cellPos, cellSize - cellPadding);
+        }
+
+        if (loaded)
+        {
+            added++;
+            addedIds.push_back(images.back().id);
+        }
+        else
+        {
+            std::cerr << "Failed to load image: " << file << std::endl;
+        }
+    }
+
+    if (!addedIds.empty())
+    {
+        RecordInsert(addedIds);
+    }
+    std::cout << "Queued " << added << " of " << files.size() << " images for decoding" << std::endl;
+}
+
+bool IsSupportedImageFile(const std::filesystem::path& path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp";
+}
+
+void DrawImportProgress()
+{
+    if (importTotal == 0)
+    {
+        return;
+    }
+
+    ImVec2 displaySize = ImGui::GetIO().DisplaySize;
+    ImGui::SetNextWindowPos(ImVec2(displaySize.x * 0.5f, displaySize.y - 80.0f), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+    ImGui::SetNextWindowSize(ImVec2(300, 0), ImGuiCond_Always);
+    ImGui::Begin("Import Progress", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoInputs |
+                                             ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing);
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "Importing %d / %d", importCompleted, importTotal);
+    ImGui::ProgressBar((float)importCompleted / importTotal, ImVec2(-1.0f, 0.0f), overlay);
+    ImGui::End();
+}
+
+// Conservative world-space test against the circle around the image, so it holds at any rotation
+bool IsImageInView(const Image& img, ImVec2 viewMin, ImVec2 viewMax)
+{
+    float displayWidth = (img.isTextImage ? img.originalWidth : img.width) * img.zoom;
+    float displayHeight = (img.isTextImage ? img.originalHeight : img.height) * img.zoom;
+    ImVec2 center(img.position.x + displayWidth * 0.5f, img.position.y + displayHeight * 0.5f);
+    float radius = 0.5f * std::sqrt(displayWidth * displayWidth + displayHeight * displayHeight);
+    return center.x + radius >= viewMin.x && center.x - radius <= viewMax.x &&
+           center.y + radius >= viewMin.y && center.y - radius <= viewMax.y;
+}
+
+// Maps a screen point back into image pixels, undoing rotation, zoom and mirroring
+ImVec2 ScreenToImagePixel(const Image& img, const ImVec2& point)
+{
+    // Calculate the center of the image on screen
+    float scale = ImageScreenScale(img);
+    ImVec2 screenPos = WorldToScreen(img.position);
+    ImVec2 center = ImVec2(screenPos.x + img.width * scale * 0.5f, 
+                           screenPos.y + img.height * scale * 0.5f);
+
+    // Translate point to origin
+    ImVec2 translated = ImVec2(point.x - center.x, point.y - center.y);
+
+    // Rotate point back
+    float cos_r = cosf(-img.rotation * 3.14159f / 180.0f);
+    float sin_r = sinf(-img.rotation * 3.14159f / 180.0f);
+    ImVec2 rotated = ImVec2(
+        translated.x * cos_r - translated.y * sin_r,
+        translated.x * sin_r + translated.y * cos_r
+    );
+
+    // Scale back to image coordinates
+    float x = (rotated.x / scale) + img.width * 0.5f;
+    float y = (rotated.y / scale) + img.height * 0.5f;
+    if (img.mirrored)
+    {
+        x = img.width - x;
+    }
+    return ImVec2(x, y);
+}
+
+// True if the screen point lands on a visible part of the image, at any rotation
+bool IsPointInImage(const Image& img, const ImVec2& point)
+{
+    ImVec2 pixel = ScreenToImagePixel(img, point);
+    if (pixel.x < 0.0f || pixel.y < 0.0f || pixel.x >= img.width || pixel.y >= img.height)
+    {
+        return false;
+    }
+    if (!img.hitMask)
+    {
+        return true;
+    }
+    const std::vector<HitMaskLevel>& levels = *img.hitMask;
+
+    // Test the level whose cells are about one screen pixel, so thin strokes can still be clicked
+    // when zoomed out
+    float cellOnScreen = hitMaskCellSize * ImageScreenScale(img);
+    size_t level = 0;
+    while (cellOnScreen < 1.0f && level + 1 < levels.size())
+    {
+        cellOnScreen *= 2.0f;
+        level++;
+    }
+    int cellSize = hitMaskCellSize << level;
+    return HitMaskBit(levels[level], (int)pixel.x / cellSize, (int)pixel.y / cellSize);
+}
+
+// Every cursor position GLFW reported since the last frame, so fast drags don't leave gaps
+std::vector<ImVec2> cursorSamples;
+
+void CursorPosCallback(GLFWwindow*, double x, double y)
+{
+    cursorSamples.push_back(ImVec2((float)x, (float)y));
+}
+
+// The eraser stroke in progress, continued from frame to frame
+struct EraserStroke {
+    int imageId;      // -1 when no stroke is in progress
+    ImVec2 lastPoint; // In image pixels
+    std::vector<MaskTile> beforeTiles;  // Mask tiles the stroke has touched, as they were before it
+    std::unordered_set<int> touchedTiles;
+};
+
+EraserStroke eraserStroke = { -1, ImVec2(0, 0), {}, {} };
+
+// Keeps the tiles under [x0,x1)x[y0,y1) the first time the stroke reaches them, before they are erased
+void RecordStrokeTiles(Image& img, int x0, int y0, int x1, int y1)
+{
+    int columns = (img.width + maskUndoTileSize - 1) / maskUndoTileSize;
+    for (int row = y0 / maskUndoTileSize; row <= (y1 - 1) / maskUndoTileSize; ++row)
+    {
+        for (int column = x0 / maskUndoTileSize; column <= (x1 - 1) / maskUndoTileSize; ++column)
+        {
+            if (eraserStroke.touchedTiles.insert(row * columns + column).second)
+            {
+                MaskTile tile = { column, row, {} };
+                tile.runs = CompressMaskTile(img, tile);
+                eraserStroke.beforeTiles.push_back(std::move(tile));
+            }
+        }
+    }
 }
 
-void LoadTextureFromFile(const char* filename, Image& img)
+// A finished stroke becomes one undo step
+void FinishEraserStroke()
 {
-    std::cout << "Loading image: " << filename << std::endl;
-    int channels;
-    unsigned char* image = stbi_load(filename, &img.width, &img.height, &channels, 4);
-    if (image == nullptr)
+    if (!eraserStroke.beforeTiles.empty())
     {
-        std::cerr << "Failed to load image" << std::endl;
-        return;
+        UndoCommand command{};
+        command.type = UndoErase;
+        command.imageIds = { eraserStroke.imageId };
+        command.maskTiles = std::move(eraserStroke.beforeTiles);
+        PushUndoCommand(std::move(command));
     }
+    eraserStroke.imageId = -1;
+    eraserStroke.beforeTiles.clear();
+    eraserStroke.touchedTiles.clear();
+}
 
-    img.data.assign(image, image + img.width * img.height * 4);
-    stbi_image_free(image);
-
-    img.texture = CreateTextureFromData(img.data, img.width, img.height);
-
-    std::cout << "Image loaded successfully. Width: " << img.width << ", Height: " << img.height << std::endl;
+// Per-row half widths of the eraser disc, so a stamp fills spans instead of testing every pixel
+const std::vector<int>& EraserSpanTable(int radius)
+{
+    static int cachedRadius = -1;
+    static std::vector<int> halfWidths;
+    if (radius != cachedRadius)
+    {
+        halfWidths.resize(2 * radius + 1);
+        for (int y = -radius; y <= radius; ++y)
+        {
+            halfWidths[y + radius] = (int)std::sqrt((float)(radius * radius - y * y));
+        }
+        cachedRadius = radius;
+    }
+    return halfWidths;
 }
 
-bool IsPointInImage(const Image& img, const ImVec2& point)
+void StampEraser(Image& img, int centerX, int centerY)
 {
-    float displayWidth = img.isTextImage ? img.originalWidth * img.zoom : img.width * img.zoom;
-    float displayHeight = img.isTextImage ? img.originalHeight * img.zoom : img.height * img.zoom;
+    int radius = img.eraserSize;
+    const std::vector<int>& halfWidths = EraserSpanTable(radius);
+
+    int minX = std::max(centerX - radius, 0);
+    int maxX = std::min(centerX + radius + 1, img.width);
+    int minY = std::max(centerY - radius, 0);
+    int maxY = std::min(centerY + radius + 1, img.height);
+    if (minX >= maxX || minY >= maxY)
+    {
+        return;
+    }
+    RecordStrokeTiles(img, minX, minY, maxX, maxY);
+
+    for (int y = minY; y < maxY; ++y)
+    {
+        int halfWidth = halfWidths[y - centerY + radius];
+        int spanStart = std::max(centerX - halfWidth, 0);
+        int spanEnd = std::min(centerX + halfWidth + 1, img.width);
+        if (spanStart < spanEnd)
+        {
+            unsigned char* row = &(*img.mask)[(size_t)y * img.width];
+            std::fill(row + spanStart, row + spanEnd, 0);
+        }
+    }
 
-    ImVec2 topLeft = img.position;
-    ImVec2 bottomRight = ImVec2(img.position.x + displayWidth, img.position.y + displayHeight);
-    return point.x >= topLeft.x && point.x <= bottomRight.x && point.y >= topLeft.y && point.y <= bottomRight.y;
+    // Queue the bounds of the stamped disc for this frame's upload
+    MarkImageDirty(img, minX, minY, maxX, maxY);
+    if (img.hitMask)
+    {
+        RefreshHitMask(*img.hitMask, ImagePixels(img), *img.mask, img.width, img.height, minX, minY, maxX, maxY);
+    }
 }
 
-void EraseImagePart(Image& img, const ImVec2& point)
+// Stamps the eraser along the cursor path collected this frame, interpolating between samples
+void EraseAlongCursorPath(Image& img)
 {
-    // Calculate the center of the image
-    ImVec2 center = ImVec2(img.position.x + img.width * img.zoom * 0.5f, 
-                           img.position.y + img.height * img.zoom * 0.5f);
-
-    // Translate point to origin
-    ImVec2 translated = ImVec2(point.x - center.x, point.y - center.y);
+    // Nothing to erase until the pixels have been decoded
+    if (img.loading)
+    {
+        return;
+    }
 
-    // Rotate point back
-    float cos_r = cosf(-img.rotation * 3.14159f / 180.0f);
-    float sin_r = sinf(-img.rotation * 3.14159f / 180.0f);
-    ImVec2 rotated = ImVec2(
-        translated.x * cos_r - translated.y * sin_r,
-        translated.x * sin_r + translated.y * cos_r
-    );
+    // Erasing only writes the mask, so the original pixels are never lost
+    EnsureEraserMask(img);
+    MakeMasksUnique(img);
 
-    // Scale back to image coordinates
-    int centerX = static_cast<int>((rotated.x / img.zoom) + img.width * 0.5f);
-    int centerY = static_cast<int>((rotated.y / img.zoom) + img.height * 0.5f);
+    std::vector<ImVec2> points = cursorSamples;
+    bool newStroke = eraserStroke.imageId != img.id;
+    if (newStroke && eraserStroke.imageId != -1)
+    {
+        FinishEraserStroke();
+    }
+    if (points.empty() && newStroke)
+    {
+        points.push_back(ImGui::GetMousePos());
+    }
 
-    for (int y = -img.eraserSize; y <= img.eraserSize; ++y)
+    float spacing = std::max(1.0f, img.eraserSize * 0.5f);
+    for (const ImVec2& screenPoint : points)
     {
-        for (int x = -img.eraserSize; x <= img.eraserSize; ++x)
+        ImVec2 point = ScreenToImagePixel(img, screenPoint);
+        if (newStroke)
         {
-            if (x*x + y*y <= img.eraserSize*img.eraserSize)
-            {
-                int pixelX = centerX + x;
-                int pixelY = centerY + y;
-                
-                // Apply mirroring if necessary
-                if (img.mirrored)
-                {
-                    pixelX = img.width - 1 - pixelX;
-                }
+            StampEraser(img, (int)point.x, (int)point.y);
+            eraserStroke.imageId = img.id;
+            eraserStroke.lastPoint = point;
+            newStroke = false;
+            continue;
+        }
 
-                if (pixelX >= 0 && pixelX < img.width && pixelY >= 0 && pixelY < img.height)
-                {
-                    int index = (pixelY * img.width + pixelX) * 4;
-                    if (img.isTextImage)
-                    {
-                        // For text images, we set the pixel to fully transparent
-                        img.pixelData[index + 3] = 0;
-                    }
-                    else
-                    {
-                        // For regular images, use the existing erasing method
-                        img.data[index + 3] = 0; // Set alpha to 0 (transparent)
-                    }
-                }
-            }
+        ImVec2 delta = ImVec2(point.x - eraserStroke.lastPoint.x, point.y - eraserStroke.lastPoint.y);
+        float distance = sqrtf(delta.x * delta.x + delta.y * delta.y);
+        int steps = (int)std::ceil(distance / spacing);
+        for (int step = 1; step <= steps; ++step)
+        {
+            float t = (float)step / steps;
+            StampEraser(img, (int)(eraserStroke.lastPoint.x + delta.x * t), (int)(eraserStroke.lastPoint.y + delta.y * t));
         }
+        eraserStroke.lastPoint = point;
     }
-
-    // Update texture
-    glBindTexture(GL_TEXTURE_2D, img.texture);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img.width, img.height, GL_RGBA, GL_UNSIGNED_BYTE, 
-                    img.isTextImage ? img.pixelData.data() : img.data.data());
 }
 
-
 Image CreateImageCopy(const Image& original)
 {
     Image copy = original;
-    copy.position.x += 20;  // Offset the copy slightly
-    copy.position.y += 20;
+    copy.id = nextImageId++;
+    copy.position.x += 20 / gridScale;  // Offset the copy slightly, by the same amount on screen at any zoom
+    copy.position.y += 20 / gridScale;
     copy.targetPosition = copy.position;
     copy.uploadOrder = nextUploadOrder++;
     copy.selected = false;  // The new copy is not selected initially
+    copy.spatial.depth = -1; // Indexed once it is in the image list
 
-    if (original.isTextImage)
-    {
-        // For text images, create a new texture from pixelData
-        copy.texture = CreateTextureFromData(copy.pixelData, copy.width, copy.height);
-    }
-    else
-    {
-        // For regular images, create a new texture from data
-        copy.texture = CreateTextureFromData(copy.data, copy.width, copy.height);
-    }
+    // The handles below belong to the original. CreateImageTextures takes another reference to the
+    // original's color texture through AcquireSharedTexture; only the mask, sharp-text and tile
+    // textures are the copy's own.
+    copy.tiles.clear();
+    copy.texture = 0;
+    copy.maskTexture = 0;
+    copy.sharpTexture = 0;
+    CreateImageTextures(copy);
 
     return copy;
 }
@@ -490,6 +3694,81 @@ bool DrawButton(ImDrawList* draw_list, float x, float y, float width, float heig
     return isHovered && ImGui::IsMouseClicked(0);
 }
 
+// Maps a point in image pixels to the screen, applying mirroring, zoom and rotation about the image center
+ImVec2 ImagePixelToScreen(const Image& img, ImVec2 pixel, ImVec2 center, float cos_r, float sin_r)
+{
+    float x = img.mirrored ? img.width - pixel.x : pixel.x;
+    float localX = (x - img.width * 0.5f) * ImageScreenScale(img);
+    float localY = (pixel.y - img.height * 0.5f) * ImageScreenScale(img);
+    return ImVec2(localX * cos_r - localY * sin_r + center.x, localX * sin_r + localY * cos_r + center.y);
+}
+
+// Draws the tiles of a huge image at the pyramid level matching its on-screen size.
+// Tiles outside the window are skipped; tiles that aren't resident yet fall back to the preview texture.
+void DrawTiledImage(Image& img, ImDrawList* draw_list, ImVec2 center, float cos_r, float sin_r)
+{
+    int level = 0;
+    float scale = ImageScreenScale(img);
+    if (scale < 1.0f)
+    {
+        level = std::min((int)std::floor(std::log2(1.0f / scale)), img.previewLevel);
+    }
+
+    int levelWidth = LevelDimension(img.width, level);
+    int levelHeight = LevelDimension(img.height, level);
+    int columns = level == img.previewLevel ? 1 : (levelWidth + textureTileSize - 1) / textureTileSize;
+    int rows = level == img.previewLevel ? 1 : (levelHeight + textureTileSize - 1) / textureTileSize;
+    float levelScaleX = (float)img.width / levelWidth;
+    float levelScaleY = (float)img.height / levelHeight;
+    ImVec2 viewportMax = ImGui::GetIO().DisplaySize;
+
+    for (int row = 0; row < rows; ++row)
+    {
+        for (int column = 0; column < columns; ++column)
+        {
+            // Tile bounds in full-resolution image pixels
+            float x0 = column * textureTileSize * levelScaleX;
+            float y0 = row * textureTileSize * levelScaleY;
+            float x1 = std::min((column + 1) * textureTileSize, levelWidth) * levelScaleX;
+            float y1 = std::min((row + 1) * textureTileSize, levelHeight) * levelScaleY;
+            if (level == img.previewLevel)
+            {
+                x1 = (float)img.width;
+                y1 = (float)img.height;
+            }
+
+            ImVec2 quad[4] = {
+                ImagePixelToScreen(img, ImVec2(x0, y0), center, cos_r, sin_r),
+                ImagePixelToScreen(img, ImVec2(x1, y0), center, cos_r, sin_r),
+                ImagePixelToScreen(img, ImVec2(x1, y1), center, cos_r, sin_r),
+                ImagePixelToScreen(img, ImVec2(x0, y1), center, cos_r, sin_r)
+            };
+            float minX = std::min({quad[0].x, quad[1].x, quad[2].x, quad[3].x});
+            float minY = std::min({quad[0].y, quad[1].y, quad[2].y, quad[3].y});
+            float maxX = std::max({quad[0].x, quad[1].x, quad[2].x, quad[3].x});
+            float maxY = std::max({quad[0].y, quad[1].y, quad[2].y, quad[3].y});
+            if (maxX < 0.0f || maxY < 0.0f || minX > viewportMax.x || minY > viewportMax.y)
+            {
+                continue;
+            }
+
+            const ImageTile* tile = level == img.previewLevel ? nullptr : AcquireTile(img, level, column, row);
+            if (tile)
+            {
+                DrawMaskedImageQuad(draw_list, tile->texture, tile->maskTexture, quad);
+            }
+            else if (img.texture)
+            {
+                // The preview level itself, or a tile that isn't streamed in yet: show the matching part of the preview
+                ImVec2 uv0(x0 / img.width, y0 / img.height);
+                ImVec2 uv1(x1 / img.width, y1 / img.height);
+                DrawMaskedImageQuad(draw_list, img.texture, img.maskTexture, quad,
+                                    uv0, ImVec2(uv1.x, uv0.y), uv1, ImVec2(uv0.x, uv1.y));
+            }
+        }
+    }
+}
+
 void DisplayImage(Image& img, bool& imageClicked)
 {
     // Smooth movement
@@ -500,12 +3779,14 @@ void DisplayImage(Image& img, bool& imageClicked)
     ImVec2 uv_max = img.mirrored ? ImVec2(0.0f, 1.0f) : ImVec2(1.0f, 1.0f);
 
     // Calculate the actual size to display
-    float displayWidth = img.isTextImage ? img.originalWidth * img.zoom : img.width * img.zoom;
-    float displayHeight = img.isTextImage ? img.originalHeight * img.zoom : img.height * img.zoom;
+    float scale = ImageScreenScale(img);
+    float displayWidth = img.isTextImage ? img.originalWidth * scale : img.width * scale;
+    float displayHeight = img.isTextImage ? img.originalHeight * scale : img.height * scale;
     ImVec2 scaled_size = ImVec2(displayWidth, displayHeight);
 
     // Calculate the center of the image
-    ImVec2 center = ImVec2(img.position.x + scaled_size.x * 0.5f, img.position.y + scaled_size.y * 0.5f);
+    ImVec2 screenPos = WorldToScreen(img.position);
+    ImVec2 center = ImVec2(screenPos.x + scaled_size.x * 0.5f, screenPos.y + scaled_size.y * 0.5f);
 
     // Calculate rotated corners
     ImVec2 corners[4] = {
@@ -536,13 +3817,39 @@ void DisplayImage(Image& img, bool& imageClicked)
         bottomRight.y = std::max(bottomRight.y, corners[i].y);
     }
 
-    // Draw the image
+    // Textures of images on screen must be resident; off-screen ones may be evicted
+    ImVec2 viewportMax = ImGui::GetIO().DisplaySize;
+    if (bottomRight.x >= 0.0f && bottomRight.y >= 0.0f && topLeft.x <= viewportMax.x && topLeft.y <= viewportMax.y)
+    {
+        EnsureImageResident(img);
+        if (img.isTextImage && !img.loading)
+        {
+            RequestSharpTextRaster(img);
+        }
+    }
+
+    // Draw the image, or a placeholder while it is still being decoded or re-uploaded
     ImDrawList* draw_list = ImGui::GetWindowDrawList();
-    draw_list->AddImageQuad(
-        (void*)(intptr_t)img.texture,
-        corners[0], corners[1], corners[2], corners[3],
-        uv_min, ImVec2(uv_max.x, uv_min.y), uv_max, ImVec2(uv_min.x, uv_max.y)
-    );
+    if (img.loading)
+    {
+        draw_list->AddQuadFilled(corners[0], corners[1], corners[2], corners[3], IM_COL32(60, 60, 70, 255));
+        draw_list->AddText(ImVec2(center.x - 30.0f, center.y - 7.0f), IM_COL32(200, 200, 200, 255), "Loading...");
+    }
+    else if (img.texture == 0)
+    {
+        draw_list->AddQuadFilled(corners[0], corners[1], corners[2], corners[3], IM_COL32(60, 60, 70, 255));
+    }
+    else if (img.tiled)
+    {
+        DrawTiledImage(img, draw_list, center, cos_r, sin_r);
+    }
+    else
+    {
+        // A sharper rendering of a text image covers the same area, so the eraser mask lines up with it too
+        GLuint texture = img.sharpTexture != 0 ? img.sharpTexture : img.texture;
+        DrawMaskedImageQuad(draw_list, texture, img.maskTexture, corners,
+                            uv_min, ImVec2(uv_max.x, uv_min.y), uv_max, ImVec2(uv_min.x, uv_max.y));
+    }
 
     // Custom hit-testing and interaction logic
     ImVec2 mousePos = ImGui::GetMousePos();
@@ -615,7 +3922,7 @@ void DisplayImage(Image& img, bool& imageClicked)
             float newZoom = img.zoomStartValue * zoomFactor;
             newZoom = std::max(0.1f, std::min(newZoom, 5.0f));
 
-            ImVec2 zoomCenter = zoomCorners[img.activeZoomCorner];
+            ImVec2 zoomCenter = ScreenToWorld(zoomCorners[img.activeZoomCorner]);
             ImVec2 centerOffset = ImVec2(zoomCenter.x - img.position.x, zoomCenter.y - img.position.y);
 
             img.targetPosition.x = zoomCenter.x - centerOffset.x * (newZoom / img.zoom);
@@ -641,7 +3948,9 @@ void DisplayImage(Image& img, bool& imageClicked)
         // Mirror button - always displays as "Mirror" with a constant color
         if (DrawButtonConditional("Mirror", IM_COL32(70, 70, 70, 255), true)) // Mirror button is always enabled
         {
+            ImageTransform before = GetImageTransform(img);
             img.mirrored = !img.mirrored;
+            RecordTransform(img, before);
             imageClicked = true;
             std::cout << "Mirror button clicked. Mirrored: " << img.mirrored << std::endl;
         }
@@ -671,32 +3980,26 @@ void DisplayImage(Image& img, bool& imageClicked)
         }
 
         // Copy button
-        if (DrawButtonConditional("Copy", IM_COL32(70, 70, 70, 255), !img.eraserMode))
+        if (DrawButtonConditional("Copy", IM_COL32(70, 70, 70, 255), !img.eraserMode && !img.loading))
         {
             Image copy = CreateImageCopy(img);
             images.push_back(copy);
+            UpdateImageSpatialIndex(images.back());
+            RecordInsert({ copy.id });
             imageClicked = true;
         }
 
         // Delete button
         if (DrawButtonConditional("Delete", IM_COL32(70, 70, 70, 255), !img.eraserMode))
         {
-            img.open = false;
+            imageToDelete = img.id;
             imageClicked = true;
         }
 
         // Move to Back button
         if (DrawButtonConditional("To Back", IM_COL32(70, 70, 70, 255), !img.eraserMode))
         {
-            int lowestOrder = std::numeric_limits<int>::max();
-            for (const auto& otherImg : images)
-            {
-                if (otherImg.uploadOrder < lowestOrder)
-                {
-                    lowestOrder = otherImg.uploadOrder;
-                }
-            }
-            img.uploadOrder = lowestOrder - 1;
+            sendImageToBack = true;
             imageClicked = true;
         }
 
@@ -740,17 +4043,22 @@ void DisplayImage(Image& img, bool& imageClicked)
         );
     }
 
-    // Handle eraser mode
-    if (img.selected && img.eraserMode && isHovered && ImGui::IsMouseDown(0))
+    // Handle eraser mode; a stroke that started on the image keeps going if the cursor briefly leaves it
+    bool strokeOnThisImage = eraserStroke.imageId == img.id;
+    if (img.selected && img.eraserMode && (isHovered || strokeOnThisImage) && ImGui::IsMouseDown(0))
     {
-        EraseImagePart(img, mousePos);
+        EraseAlongCursorPath(img);
         imageClicked = true;
     }
+    else if (strokeOnThisImage)
+    {
+        FinishEraserStroke();
+    }
 
     // Draw eraser cursor
     if (img.selected && img.eraserMode && isHovered)
     {
-        float radius = img.eraserSize * img.zoom / 2.0f;
+        float radius = img.eraserSize * ImageScreenScale(img) / 2.0f;
         draw_list->AddCircle(mousePos, radius, IM_COL32(255, 255, 255, 200), 0, 2.0f);
     }
 
@@ -763,6 +4071,60 @@ void DisplayImage(Image& img, bool& imageClicked)
 
     // Reset hover state
     img.isHoveringZoomControl = isInteractingWithZoomControl;
+
+    // Position, zoom and rotation may all have changed above
+    UpdateImageSpatialIndex(img);
+}
+
+// Layout scales linearly with the font size, so the world-space size holds at any camera zoom
+ImVec2 TextWorldSize(Text& text)
+{
+    if (text.measuredFontIndex != text.fontIndex || text.measuredFontSize != text.size || text.measuredContent != text.content)
+    {
+        text.measuredSize = MeasureText(text.fontIndex, text.size, text.content.c_str());
+        text.measuredContent = text.content;
+        text.measuredFontIndex = text.fontIndex;
+        text.measuredFontSize = text.size;
+    }
+    return text.measuredSize;
+}
+
+// World-space box the text is hit-tested and culled on: the laid-out text with a quarter of the
+// font size of padding, widened by the stroke
+void UpdateTextSpatialIndex(Text& text)
+{
+    ImVec2 worldSize = TextWorldSize(text);
+    float margin = text.size * 0.25f + text.strokeWidth;
+    text.spatial.text = &text;
+    UpdateSpatialIndex(textIndex, text.spatial,
+                       ImVec2(text.position.x - margin, text.position.y - margin),
+                       ImVec2(text.position.x + worldSize.x + margin, text.position.y + worldSize.y + margin));
+}
+
+// Texts live in a vector, so adding or removing one can move the others and leave the index
+// pointing at stale entries. The index is rebuilt whenever the vector's storage or length
+// differs from when it was last built.
+const Text* indexedTexts = nullptr;
+size_t indexedTextCount = 0;
+
+void SyncTextSpatialIndex()
+{
+    if (texts.data() == indexedTexts && texts.size() == indexedTextCount)
+    {
+        return;
+    }
+    for (auto& cells : textIndex.cells)
+    {
+        cells.clear();
+    }
+    textIndex.count = 0;
+    for (auto& text : texts)
+    {
+        text.spatial.depth = -1;
+        UpdateTextSpatialIndex(text);
+    }
+    indexedTexts = texts.data();
+    indexedTextCount = texts.size();
 }
 
 void HandleTextInterface(ImVec2 windowSize, bool& textClicked)
@@ -780,40 +4142,58 @@ void HandleTextInterface(ImVec2 windowSize, bool& textClicked)
     ImGuiIO& io = ImGui::GetIO();
 
     bool clickedOnAnyText = false;
+    ImVec2 viewportMax = io.DisplaySize;
+    textsDrawn = textsCulled = 0;
 
     if (!colorPickerOpen && !isAddTextPopupOpen)
     {
-        for (auto& text : texts)
+        // Only the texts the index finds in view are drawn and hit-tested, plus the one being
+        // interacted with; sorting by address keeps the vector's drawing order. The selection
+        // outlives Clear All, so it is only followed while it still points into the vector.
+        SyncTextSpatialIndex();
+        std::vector<SpatialEntry*> inView;
+        QuerySpatialIndex(textIndex, ScreenToWorld(ImVec2(0.0f, 0.0f)), ScreenToWorld(viewportMax), inView);
+        std::vector<Text*> visibleTexts;
+        for (SpatialEntry* spatial : inView)
         {
-            ImVec2 screenPos = ImVec2(
-                text.position.x * gridScale + gridOffset.x,
-                text.position.y * gridScale + gridOffset.y
-            );
+            visibleTexts.push_back(spatial->text);
+        }
+        for (Text* active : { selectedText, draggedText })
+        {
+            bool inVector = active >= texts.data() && active < texts.data() + texts.size();
+            if (inVector && std::find(visibleTexts.begin(), visibleTexts.end(), active) == visibleTexts.end())
+            {
+                visibleTexts.push_back(active);
+            }
+        }
+        std::sort(visibleTexts.begin(), visibleTexts.end());
+        textsDrawn = (int)visibleTexts.size();
+        textsCulled = (int)texts.size() - textsDrawn;
+
+        for (Text* visibleText : visibleTexts)
+        {
+            Text& text = *visibleText;
+            ImVec2 screenPos = WorldToScreen(text.position);
 
-            ImFont* font = loadedFonts[text.fontIndex];
             float scaledSize = text.size * gridScale;
 
-            ImVec2 textSize = font->CalcTextSizeA(scaledSize, FLT_MAX, 0.0f, text.content.c_str());
+            ImVec2 worldSize = TextWorldSize(text);
+            ImVec2 textSize = ImVec2(worldSize.x * gridScale, worldSize.y * gridScale);
             
             float padding = scaledSize * 0.25f;
 
             ImVec2 boxMin = ImVec2(screenPos.x - padding, screenPos.y - padding);
             ImVec2 boxMax = ImVec2(screenPos.x + textSize.x + padding, screenPos.y + textSize.y + padding);
 
-            ImU32 fillColor = ImGui::ColorConvertFloat4ToU32(text.fillColor);
-            ImU32 strokeColor = ImGui::ColorConvertFloat4ToU32(text.strokeColor);
-            
-            if (text.strokeWidth > 0)
+            if (CanDrawSdfText(scaledSize, text.strokeWidth * gridScale))
             {
-                for (float x = -text.strokeWidth; x <= text.strokeWidth; x += 0.5f)
-                {
-                    for (float y = -text.strokeWidth; y <= text.strokeWidth; y += 0.5f)
-                    {
-                        draw_list->AddText(font, scaledSize, ImVec2(screenPos.x + x, screenPos.y + y), strokeColor, text.content.c_str());
-                    }
-                }
+                DrawSdfText(draw_list, text.fontIndex, scaledSize, screenPos, text.fillColor,
+                            text.strokeColor, text.strokeWidth * gridScale, text.content.c_str());
+            }
+            else
+            {
+                DrawCachedText(draw_list, text, screenPos, gridScale);
             }
-            draw_list->AddText(font, scaledSize, screenPos, fillColor, text.content.c_str());
 
             bool isHovered = ImGui::IsMouseHoveringRect(boxMin, boxMax);
             if (isHovered && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
@@ -896,6 +4276,8 @@ void HandleTextInterface(ImVec2 windowSize, bool& textClicked)
                 textClicked = true;
                 clickedOnAnyText = true;
             }
+
+            UpdateTextSpatialIndex(text);
         }
 
         if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && !clickedOnAnyText)
@@ -965,34 +4347,32 @@ void HandleTextInterface(ImVec2 windowSize, bool& textClicked)
         ImGui::InputTextMultiline("##Text", textBuffer, IM_ARRAYSIZE(textBuffer), ImVec2(330, 60), ImGuiInputTextFlags_AllowTabInput);
         ImGui::PopStyleColor();
 
-        ImFont* previewFont = loadedFonts[selectedFont];
         float previewFontSize = fontSizeValues[selectedFontSize];
 
-        ImVec2 textSize = previewFont->CalcTextSizeA(previewFontSize, FLT_MAX, 0.0f, textBuffer);
+        ImVec2 textSize = MeasureText(selectedFont, previewFontSize, textBuffer);
         ImVec2 previewSize = ImVec2(std::max(textSize.x + 10.0f, 330.0f), std::max(textSize.y + 10.0f, 100.0f));
 
         ImVec2 pos = ImGui::GetCursorScreenPos();
         
         ImDrawList* drawList = ImGui::GetWindowDrawList();
-        ImU32 fillColorU32 = ImGui::ColorConvertFloat4ToU32(fillColor);
-        ImU32 strokeColorU32 = ImGui::ColorConvertFloat4ToU32(strokeColor);
 
         ImVec2 previewBoxMin = ImVec2(pos.x, pos.y);
         ImVec2 previewBoxMax = ImVec2(pos.x + previewSize.x, pos.y + previewSize.y);
         drawList->AddRectFilled(previewBoxMin, previewBoxMax, IM_COL32(50, 50, 50, 255));
 
+        // The preview goes through the same cache as placed texts, so it only re-renders while being edited
+        static Text previewText;
+        previewText.content = textBuffer;
+        previewText.fontIndex = selectedFont;
+        previewText.size = previewFontSize;
+        previewText.fillColor = fillColor;
+        previewText.strokeColor = strokeColor;
+        previewText.strokeWidth = strokeWidth;
+
         ImVec2 textPos = ImVec2(pos.x + 5, pos.y + 5);
-        if (strokeWidth > 0)
-        {
-            for (float x = -strokeWidth; x <= strokeWidth; x += 0.5f)
-            {
-                for (float y = -strokeWidth; y <= strokeWidth; y += 0.5f)
-                {
-                    drawList->AddText(previewFont, previewFontSize, ImVec2(textPos.x + x, textPos.y + y), strokeColorU32, textBuffer);
-                }
-            }
-        }
-        drawList->AddText(previewFont, previewFontSize, textPos, fillColorU32, textBuffer);
+        drawList->PushClipRect(previewBoxMin, previewBoxMax, true);
+        DrawCachedText(drawList, previewText, textPos, 1.0f);
+        drawList->PopClipRect();
 
         ImGui::Dummy(previewSize);
 
@@ -1006,37 +4386,52 @@ void HandleTextInterface(ImVec2 windowSize, bool& textClicked)
                 ImVec2 screenCenter = ImVec2(windowSize.x * 0.5f, windowSize.y * 0.5f);
 
                 // Convert screen coordinates to world coordinates
-                ImVec2 worldPos = ImVec2(
-                    (screenCenter.x - gridOffset.x) / gridScale,
-                    (screenCenter.y - gridOffset.y) / gridScale
-                );
+                ImVec2 worldPos = ScreenToWorld(screenCenter);
 
-                // Render text to texture
-                auto [textureID, pixelData] = RenderTextToTexture(textBuffer, previewFont, previewFontSize, fillColor, strokeColor, strokeWidth);
-
-                // Calculate the size of the text
-                ImVec2 textSize = previewFont->CalcTextSizeA(previewFontSize, FLT_MAX, 0.0f, textBuffer);
+                // Render the text; the texture is made from the image's pixel buffer below
+                int texWidth, texHeight;
+                std::vector<unsigned char> pixelData = RenderTextToPixels(textBuffer, selectedFont, previewFontSize, fillColor, strokeColor,
+                                                                          strokeWidth, texWidth, texHeight);
 
                 // Add the texture as an image to your images collection
                 Image newImage;
-                newImage.texture = textureID;
-                newImage.width = (int)(textSize.x + strokeWidth * 2 + 10);
-                newImage.height = (int)(textSize.y + strokeWidth * 2 + 10);
+                newImage.id = nextImageId++;
+                newImage.texture = 0;
+                newImage.width = texWidth;
+                newImage.height = texHeight;
                 newImage.position = worldPos;
                 newImage.targetPosition = worldPos;
-                newImage.zoom = 1.0f;
+                newImage.zoom = 1.0f / gridScale; // One texel per screen pixel at the current view
                 newImage.rotation = 0.0f;
                 newImage.name = "Text Image";
                 newImage.open = true;
                 newImage.selected = false;
                 newImage.mirrored = false;
                 newImage.uploadOrder = nextUploadOrder++;
-                newImage.pixelData = pixelData;
+                newImage.pixelData = std::make_shared<const std::vector<unsigned char>>(std::move(pixelData));
                 newImage.isTextImage = true;
+                newImage.hitMask = std::make_shared<std::vector<HitMaskLevel>>(BuildHitMask(*newImage.pixelData, newImage.width, newImage.height));
+                newImage.textContent = textBuffer;
+                newImage.textFontIndex = selectedFont;
+                newImage.textFontSize = previewFontSize;
+                newImage.textFillColor = fillColor;
+                newImage.textStrokeColor = strokeColor;
+                newImage.textStrokeWidth = strokeWidth;
+                newImage.sharpTexture = 0;
+                newImage.sharpScale = 1.0f;
+                newImage.sharpPending = false;
+                newImage.sharpRequestScale = 0.0f;
+                newImage.loading = false;
+                newImage.tiled = false;
+                newImage.previewLevel = 0;
+                newImage.maskTexture = 0;
+                newImage.lastVisibleFrame = frameCounter;
+                newImage.hasDirtyRect = false;
                 newImage.eraserMode = false;
                 newImage.eraserSize = 5;
                 newImage.isHoveringZoomControl = false;
                 newImage.activeZoomCorner = -1;
+                newImage.spatial.depth = -1;
                 
                 // Store the original size of the text image
                 newImage.originalWidth = newImage.width;
@@ -1047,11 +4442,10 @@ void HandleTextInterface(ImVec2 windowSize, bool& textClicked)
                 newImage.position.y -= newImage.height * 0.5f / gridScale;
                 newImage.targetPosition = newImage.position;
 
-                // Save current state for undo
-                undoStates.push_back({images, nextUploadOrder});
-                redoStates.clear();
-
                 images.push_back(newImage);
+                CreateImageTextures(images.back());
+                UpdateImageSpatialIndex(images.back());
+                RecordInsert({ newImage.id });
 
                 ImGui::CloseCurrentPopup();
                 isAddTextPopupOpen = false;
@@ -1071,6 +4465,7 @@ void HandleTextInterface(ImVec2 windowSize, bool& textClicked)
 
     if (selectedText && ImGui::IsKeyPressed(ImGuiKey_Delete) && !colorPickerOpen && !isAddTextPopupOpen)
     {
+        ReleaseTextCache(*selectedText);
         texts.erase(std::remove_if(texts.begin(), texts.end(),
             [&](const Text& t) { return &t == selectedText; }),
             texts.end());
@@ -1091,6 +4486,21 @@ void ShowImageViewer(bool* p_open)
     static ImVec2 dragStartPos;
     static bool isGrabbingGrid = false;
     static ImVec2 gridGrabStartPos;
+    static int gestureImageId = -1;       // The image a drag, corner zoom or rotation is changing
+    static ImageTransform gestureStart;
+
+    // Drops the selection, before the selected image may leave the list
+    auto DeselectImage = [&]()
+    {
+        if (selectedImage)
+        {
+            selectedImage->selected = false;
+            selectedImage->eraserMode = false;
+        }
+        selectedImage = nullptr;
+        draggedImage = nullptr;
+        gestureImageId = -1;
+    };
 
     ImGui::SetNextWindowPos(ImVec2(0, 0));
     ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
@@ -1100,6 +4510,15 @@ void ShowImageViewer(bool* p_open)
     ImVec2 windowPos = ImGui::GetWindowPos();
     ImVec2 windowSize = ImGui::GetIO().DisplaySize;
 
+    frameCounter++;
+    tileUploadsThisFrame = 0;
+    residencyUploadBytesThisFrame = 0;
+
+    // Upload any images the worker pool finished decoding since the last frame
+    ProcessDecodedImages();
+    ProcessTextRasters();
+    sdfTextParams.clear();
+
     // Draw the grid for the entire window
     DrawGrid(draw_list, windowPos, windowSize);
 
@@ -1109,45 +4528,32 @@ void ShowImageViewer(bool* p_open)
     {
         std::cout << "Load Image button clicked" << std::endl;
         const char* filters[] = { "*.png", "*.jpg", "*.jpeg", "*.bmp" };
-        const char* file = tinyfd_openFileDialog(
+        const char* selection = tinyfd_openFileDialog(
             "Open Image",
             "",
             4,
             filters,
             "Image Files",
-            0
+            1
         );
-        if (file)
+        if (selection)
         {
-            std::cout << "File selected: " << file << std::endl;
-            Image img;
-            LoadTextureFromFile(file, img);
-            if (img.texture)
+            // Multiple selections come back as one string separated by '|'
+            std::vector<std::string> files;
+            std::string remaining = selection;
+            size_t separator;
+            while ((separator = remaining.find('|')) != std::string::npos)
             {
-                // Save state for undo
-                undoStates.push_back({images, nextUploadOrder});
-                redoStates.clear();
-
-                img.zoom = 1.0f;
-                img.position = img.targetPosition = ImVec2(50, 50);
-                img.name = file;
-                img.open = true;
-                img.selected = false;
-                img.mirrored = false;
-                img.uploadOrder = nextUploadOrder++;
-                img.eraserMode = false;
-                img.eraserSize = 5;
-                img.rotation = 0.0f;
-                img.targetRotation = 0.0f;
-                img.isHoveringZoomControl = false;
-                img.activeZoomCorner = -1;
-                images.push_back(img);
-                std::cout << "Image added to the viewer" << std::endl;
+                files.push_back(remaining.substr(0, separator));
+                remaining.erase(0, separator + 1);
             }
-            else
+            if (!remaining.empty())
             {
-                std::cerr << "Failed to load image texture" << std::endl;
+                files.push_back(remaining);
             }
+
+            std::cout << "Files selected: " << files.size() << std::endl;
+            ImportImageFiles(files);
         }
         else
         {
@@ -1156,82 +4562,68 @@ void ShowImageViewer(bool* p_open)
     }
 
     ImGui::SameLine();
-    if (ImGui::Button("Clear All"))
+    if (ImGui::Button("Load Folder"))
     {
-        // Save current state for undo
-        undoStates.push_back({images, nextUploadOrder});
-        redoStates.clear();
+        const char* folder = tinyfd_selectFolderDialog("Import Folder", "");
+        if (folder)
+        {
+            std::vector<std::string> files;
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator(folder, error))
+            {
+                if (entry.is_regular_file() && IsSupportedImageFile(entry.path()))
+                {
+                    files.push_back(entry.path().string());
+                }
+            }
+            // Directory iteration order is unspecified; sort for a stable upload order
+            std::sort(files.begin(), files.end());
 
-        std::cout << "Clear All button clicked" << std::endl;
-        for (const auto& img : images)
+            std::cout << "Folder selected: " << folder << " (" << files.size() << " images)" << std::endl;
+            ImportImageFiles(files);
+        }
+        else
         {
-            glDeleteTextures(1, &img.texture);
+            std::cerr << "No folder selected or dialog cancelled" << std::endl;
         }
-        images.clear();
-        texts.clear();  // Clear texts as well
-        nextUploadOrder = 0;
-        selectedImage = nullptr;
-        draggedImage = nullptr;
     }
 
     ImGui::SameLine();
-    if (ImGui::Button("Undo") && !undoStates.empty())
+    if (ImGui::Button("Clear All"))
     {
-        // Save current state for redo
-        redoStates.push_back({images, nextUploadOrder});
-
-        // Restore previous state
-        ImageState prevState = undoStates.back();
-        undoStates.pop_back();
-
-        // Clear current images
+        std::cout << "Clear All button clicked" << std::endl;
+        DeselectImage();
+        std::vector<int> ids;
         for (const auto& img : images)
         {
-            glDeleteTextures(1, &img.texture);
+            ids.push_back(img.id);
         }
-
-        // Restore images and nextUploadOrder
-        images = prevState.images;
-        nextUploadOrder = prevState.nextUploadOrder;
-
-        // Recreate textures for restored images
-        for (auto& img : images)
+        RemoveImagesWithUndo(ids);
+        for (auto& text : texts)
         {
-            img.texture = CreateTextureFromData(img.data, img.width, img.height);
+            ReleaseTextCache(text);
         }
-
-        selectedImage = nullptr;
-        draggedImage = nullptr;
+        texts.clear();  // Clear texts as well
     }
 
     ImGui::SameLine();
-    if (ImGui::Button("Redo") && !redoStates.empty())
+    if (ImGui::Button("Undo") && !undoHistory.empty())
     {
-        // Save current state for undo
-        undoStates.push_back({images, nextUploadOrder});
-
-        // Restore next state
-        ImageState nextState = redoStates.back();
-        redoStates.pop_back();
-
-        // Clear current images
-        for (const auto& img : images)
-        {
-            glDeleteTextures(1, &img.texture);
-        }
-
-        // Restore images and nextUploadOrder
-        images = nextState.images;
-        nextUploadOrder = nextState.nextUploadOrder;
-
-        // Recreate textures for restored images
-        for (auto& img : images)
-        {
-            img.texture = CreateTextureFromData(img.data, img.width, img.height);
-        }
+        DeselectImage();
+        UndoCommand command = std::move(undoHistory.back());
+        undoHistory.pop_back();
+        ApplyUndoCommand(command, true);
+        redoHistory.push_back(std::move(command));
+    }
 
-        selectedImage = nullptr;
-        draggedImage = nullptr;
+    ImGui::SameLine();
+    if (ImGui::Button("Redo") && !redoHistory.empty())
+    {
+        DeselectImage();
+        UndoCommand command = std::move(redoHistory.back());
+        redoHistory.pop_back();
+        ApplyUndoCommand(command, false);
+        undoHistory.push_back(std::move(command));
     }
 
     ImGui::SameLine();
@@ -1239,31 +4631,59 @@ void ShowImageViewer(bool* p_open)
 
     ImGui::BeginChild("ImageDisplayArea", ImVec2(0, -30), false, ImGuiWindowFlags_HorizontalScrollbar);
     
-    // Sort images based on upload order (ascending)
-    std::sort(images.begin(), images.end(), [](const Image& a, const Image& b) {
-        return a.uploadOrder < b.uploadOrder;
-    });
-
     ImVec2 mousePos = ImGui::GetMousePos();
     ImVec2 relativeMousePos = ImVec2(mousePos.x - windowPos.x, mousePos.y - windowPos.y);
 
     Image* hoveredImage = nullptr;
     bool imageClicked = false;
 
-    // Display all images and find the topmost hovered image
-    for (auto& img : images)
+    // Display all images. Images outside the view are skipped entirely, unless selected, since
+    // their controls may still be in use.
+    ImVec2 viewMin = ScreenToWorld(ImVec2(0, 0));
+    ImVec2 viewMax = ScreenToWorld(ImGui::GetIO().DisplaySize);
+    imagesDrawn = imagesCulled = 0;
+    auto imageToBack = images.end();
+    for (auto it = images.begin(); it != images.end(); ++it)
     {
+        Image& img = *it;
         if (img.open)
         {
-            DisplayImage(img, imageClicked);
+            if (!img.selected && !IsImageInView(img, viewMin, viewMax))
+            {
+                imagesCulled++;
+                continue;
+            }
+            imagesDrawn++;
 
-            if (IsPointInImage(img, relativeMousePos))
+            DisplayImage(img, imageClicked);
+            if (sendImageToBack)
             {
-                hoveredImage = &img;
+                imageToBack = it;
+                sendImageToBack = false;
             }
         }
     }
 
+    // The topmost image under the cursor, among the few the spatial index returns; uploadOrder
+    // increases from back to front
+    ImVec2 mouseWorld = ScreenToWorld(relativeMousePos);
+    std::vector<SpatialEntry*> candidates;
+    QuerySpatialIndex(imageIndex, mouseWorld, mouseWorld, candidates);
+    for (SpatialEntry* spatial : candidates)
+    {
+        Image* candidate = spatial->image;
+        if (candidate->open && IsPointInImage(*candidate, relativeMousePos) &&
+            (!hoveredImage || candidate->uploadOrder > hoveredImage->uploadOrder))
+        {
+            hoveredImage = candidate;
+        }
+    }
+
+    if (imageToBack != images.end())
+    {
+        SendImageToBack(imageToBack);
+    }
+
     bool textClicked = false;
     HandleTextInterface(ImGui::GetWindowSize(), textClicked);
 
@@ -1331,6 +4751,13 @@ void ShowImageViewer(bool* p_open)
                 isGrabbingGrid = true;
                 gridGrabStartPos = ImGui::GetMousePos();
             }
+
+            // A drag, corner zoom or rotation becomes one undo step when the button is released
+            gestureImageId = selectedImage ? selectedImage->id : -1;
+            if (selectedImage)
+            {
+                gestureStart = GetImageTransform(*selectedImage);
+            }
         }
 
         // Handle dragging
@@ -1340,33 +4767,16 @@ void ShowImageViewer(bool* p_open)
             if (draggedImage && !draggedImage->eraserMode)
             {
                 // Move only the dragged image if not in eraser mode
-                draggedImage->position.x += dragDelta.x;
-                draggedImage->position.y += dragDelta.y;
+                draggedImage->position.x += dragDelta.x / gridScale;
+                draggedImage->position.y += dragDelta.y / gridScale;
                 draggedImage->targetPosition = draggedImage->position;
+                UpdateImageSpatialIndex(*draggedImage);
             }
             else if (isGrabbingGrid)
             {
-                // Move the grid and all images
-                ImVec2 oldGridOffset = gridOffset;
+                // Pan the camera; images and texts stay where they are in the world
                 gridOffset.x += dragDelta.x;
                 gridOffset.y += dragDelta.y;
-                
-                ImVec2 gridMovement = ImVec2(gridOffset.x - oldGridOffset.x, gridOffset.y - oldGridOffset.y);
-                for (auto& img : images)
-                {
-                    if (img.open)
-                    {
-                        img.position.x += gridMovement.x;
-                        img.position.y += gridMovement.y;
-                        img.targetPosition = img.position;
-                    }
-                }
-                // Move texts with the grid
-                for (auto& text : texts)
-                {
-                    text.position.x += gridMovement.x / gridScale;
-                    text.position.y += gridMovement.y / gridScale;
-                }
             }
             ImGui::ResetMouseDragDelta(ImGuiMouseButton_Left);
         }
@@ -1374,6 +4784,11 @@ void ShowImageViewer(bool* p_open)
         // Reset dragged image and grid grabbing when mouse is released
         if (ImGui::IsMouseReleased(ImGuiMouseButton_Left))
         {
+            if (selectedImage && selectedImage->id == gestureImageId)
+            {
+                RecordTransform(*selectedImage, gestureStart);
+            }
+            gestureImageId = -1;
             draggedImage = nullptr;
             isGrabbingGrid = false;
         }
@@ -1394,36 +4809,25 @@ void ShowImageViewer(bool* p_open)
             );
             gridOffset.x = mousePos.x - windowPos.x - mouseGridPos.x * gridScale;
             gridOffset.y = mousePos.y - windowPos.y - mouseGridPos.y * gridScale;
+        }
+    }
 
-            // Adjust image positions and sizes based on zoom
-            for (auto& img : images)
-            {
-                ImVec2 imgGridPos = ImVec2(
-                    (img.position.x - gridOffset.x) / oldGridScale,
-                    (img.position.y - gridOffset.y) / oldGridScale
-                );
-                img.position.x = gridOffset.x + imgGridPos.x * gridScale;
-                img.position.y = gridOffset.y + imgGridPos.y * gridScale;
-                img.targetPosition = img.position;
-                img.zoom *= zoomFactor;
-            }
-
-            // Adjust text positions and sizes based on zoom
-            for (auto& text : texts)
-            {
-                ImVec2 textGridPos = ImVec2(
-                    (text.position.x - gridOffset.x) / oldGridScale,
-                    (text.position.y - gridOffset.y) / oldGridScale
-                );
-                text.position.x = gridOffset.x + textGridPos.x * gridScale;
-                text.position.y = gridOffset.y + textGridPos.y * gridScale;
-                text.size *= zoomFactor; // Adjust text size based on zoom
-            }
+    if (imageToDelete != -1)
+    {
+        if (selectedImage && selectedImage->id == imageToDelete)
+        {
+            DeselectImage();
         }
+        RemoveImagesWithUndo({ imageToDelete });
+        imageToDelete = -1;
     }
 
-    images.erase(std::remove_if(images.begin(), images.end(),
-        [&](const Image& img) { 
+    FlushImageUploads(images);
+    EnforceTextureBudget(images);
+    FlushGlyphPages();
+
+    images.remove_if(
+        [&](Image& img) { 
             if (!img.open) {
                 if (&img == selectedImage) {
                     selectedImage = nullptr;
@@ -1431,19 +4835,41 @@ void ShowImageViewer(bool* p_open)
                 if (&img == draggedImage) {
                     draggedImage = nullptr;
                 }
-                glDeleteTextures(1, &img.texture);
+                RemoveImageFromSpatialIndex(img);
+                DeleteImageTextures(img);
                 return true;
             }
             return false;
-        }), images.end());
+        });
 
     ImGui::EndChild();
 
     ImGui::End();
 
+    DrawImportProgress();
+
     if (show_metrics)
     {
         ImGui::ShowMetricsWindow(&show_metrics);
+
+        ImGui::Begin("Canvas Metrics", &show_metrics);
+        ImGui::Text("Resident textures: %.1f / %d MB", residentTextureBytes / (1024.0f * 1024.0f), textureBudgetMB);
+        ImGui::SliderInt("Texture budget (MB)", &textureBudgetMB, 64, 4096);
+        ImGui::Checkbox("Distance field text", &sdfTextEnabled);
+        ImGui::Text("Images: %d drawn, %d culled", imagesDrawn, imagesCulled);
+        ImGui::Text("Texts: %d drawn, %d culled", textsDrawn, textsCulled);
+        ImGui::Text("Spatial index: %d images, %d texts", imageIndex.count, textIndex.count);
+        ImGui::Text("Image textures: %d shared by pixel buffer", (int)sharedTextures.size());
+        {
+            std::lock_guard<std::mutex> lock(glyphMutex);
+            size_t glyphCount = 0;
+            for (const auto& face : fontFaces)
+            {
+                glyphCount += face.glyphs.size();
+            }
+            ImGui::Text("Glyph atlas: %d page(s), %d glyphs", (int)glyphPages.size(), (int)glyphCount);
+        }
+        ImGui::End();
     }
 }
 
@@ -1491,12 +4917,28 @@ int main(int, char**)
     ImGui::StyleColorsDark();
 
     // Setup Platform/Renderer backends
+    // Installed before the ImGui backend, which chains to it, to collect sub-frame cursor samples for the eraser
+    glfwSetCursorPosCallback(window, CursorPosCallback);
+
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 120");
 
     // Load fonts
     LoadFonts();
 
+    // Images larger than the driver limit are split into tiles
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    std::cout << "Max texture size: " << maxTextureSize << std::endl;
+
+    // Eraser masks are one byte per pixel, so their rows aren't 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Bring back the glyphs rasterized in earlier sessions
+    LoadGlyphCache();
+
+    // Start the threads used for background image decoding
+    StartWorkerPool();
+
     // Main loop
     while (!glfwWindowShouldClose(window))
     {
@@ -1521,9 +4963,13 @@ int main(int, char**)
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         glfwSwapBuffers(window);
+
+        cursorSamples.clear();
     }
 
     // Cleanup
+    StopWorkerPool();
+    CloseGlyphCache();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();